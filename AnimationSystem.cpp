@@ -0,0 +1,303 @@
+#include "AnimationSystem.h"
+#include <algorithm>
+#include <cfloat>
+
+using json = nlohmann::json;
+
+namespace
+{
+	const char* TRACK_NAMES[] = { "position", "colour", "radius", "reflection", "transparency" };
+
+	// Same limits as the old per-frame stepping, which clamped after every step
+	const float TRACK_MIN[] = { -FLT_MAX, -FLT_MAX, 0.1f, 0.0f, 0.0f };
+	const float TRACK_MAX[] = { FLT_MAX, 1.0f, FLT_MAX, 1.0f, 1.0f };
+
+	bool IsVectorTrack(int type)
+	{
+		return type == (int)AnimationType::Position || type == (int)AnimationType::Colour;
+	}
+
+	Vec3f ClampToType(int type, const Vec3f& v)
+	{
+		return Vec3f(std::min(std::max(v.x, TRACK_MIN[type]), TRACK_MAX[type]),
+			std::min(std::max(v.y, TRACK_MIN[type]), TRACK_MAX[type]),
+			std::min(std::max(v.z, TRACK_MIN[type]), TRACK_MAX[type]));
+	}
+}
+
+AnimationSystem* AnimationSystem::m_instance = 0;
+
+AnimationSystem::AnimationSystem()
+{
+}
+
+AnimationSystem::~AnimationSystem()
+{
+}
+
+void AnimationSystem::Clear()
+{
+	for (int type = 0; type < TRACK_TYPES; type++)
+	{
+		m_trackSphere[type].clear();
+		m_firstKey[type].clear();
+		m_keyNum[type].clear();
+		m_extrapolate[type].clear();
+		m_trackStart[type].clear();
+		m_results[type].clear();
+		m_keyFrames[type].clear();
+		m_keyValues[type].clear();
+		m_segTrack[type].clear();
+		m_segStart[type].clear();
+		m_segInvSpan[type].clear();
+		m_segMaxMix[type].clear();
+		m_segDelta[type].clear();
+	}
+}
+
+bool AnimationSystem::HasTracks() const
+{
+	for (int type = 0; type < TRACK_TYPES; type++)
+	{
+		if (!m_trackSphere[type].empty())
+			return true;
+	}
+	return false;
+}
+
+void AnimationSystem::SetTrack(unsigned int sphere, AnimationType type,
+	const std::vector<float>& frames, const std::vector<Vec3f>& values, bool extrapolate)
+{
+	if (type == AnimationType::Max)
+		return;
+
+	int t = (int)type;
+	for (unsigned int track = 0; track < m_trackSphere[t].size(); track++)
+	{
+		if (m_trackSphere[t][track] != sphere)
+			continue;
+
+		// drop the old keys and shift the tracks stored after them
+		unsigned int first = m_firstKey[t][track], num = m_keyNum[t][track];
+		m_keyFrames[t].erase(m_keyFrames[t].begin() + first, m_keyFrames[t].begin() + first + num);
+		m_keyValues[t].erase(m_keyValues[t].begin() + first, m_keyValues[t].begin() + first + num);
+		for (unsigned int other = 0; other < m_firstKey[t].size(); other++)
+		{
+			if (m_firstKey[t][other] > first)
+				m_firstKey[t][other] -= num;
+		}
+
+		m_trackSphere[t].erase(m_trackSphere[t].begin() + track);
+		m_firstKey[t].erase(m_firstKey[t].begin() + track);
+		m_keyNum[t].erase(m_keyNum[t].begin() + track);
+		m_extrapolate[t].erase(m_extrapolate[t].begin() + track);
+		break;
+	}
+
+	size_t keyNum = std::min(frames.size(), values.size());
+	if (keyNum > 0)
+	{
+		m_trackSphere[t].push_back(sphere);
+		m_firstKey[t].push_back((unsigned int)m_keyFrames[t].size());
+		m_keyNum[t].push_back((unsigned int)keyNum);
+		m_extrapolate[t].push_back(extrapolate);
+		m_keyFrames[t].insert(m_keyFrames[t].end(), frames.begin(), frames.begin() + keyNum);
+		m_keyValues[t].insert(m_keyValues[t].end(), values.begin(), values.begin() + keyNum);
+	}
+	BuildSegments(t);
+}
+
+void AnimationSystem::BuildSegments(int type)
+{
+	m_trackStart[type].clear();
+	m_segTrack[type].clear();
+	m_segStart[type].clear();
+	m_segInvSpan[type].clear();
+	m_segMaxMix[type].clear();
+	m_segDelta[type].clear();
+
+	for (unsigned int track = 0; track < m_trackSphere[type].size(); track++)
+	{
+		unsigned int first = m_firstKey[type][track];
+		unsigned int last = first + m_keyNum[type][track] - 1;
+		m_trackStart[type].push_back(m_keyValues[type][first]);
+		for (unsigned int key = first; key < last; key++)
+		{
+			// keys on the same frame jump to the second value just after it
+			float span = m_keyFrames[type][key + 1] - m_keyFrames[type][key];
+			bool open = m_extrapolate[type][track] && key + 1 == last && span > 0;
+			m_segTrack[type].push_back(track);
+			m_segStart[type].push_back(m_keyFrames[type][key]);
+			m_segInvSpan[type].push_back(span > 0 ? 1 / span : FLT_MAX);
+			m_segMaxMix[type].push_back(open ? FLT_MAX : 1.0f);
+			m_segDelta[type].push_back(m_keyValues[type][key + 1] - m_keyValues[type][key]);
+		}
+	}
+	m_results[type].resize(m_trackSphere[type].size());
+}
+
+void AnimationSystem::AddAnimation(unsigned int sphere, const Sphere& restPose, const Animation& anim)
+{
+	Vec3f rest, step = anim.changeTo;
+	switch (anim.aType)
+	{
+	case AnimationType::Position:
+		rest = restPose.center;
+		break;
+	case AnimationType::Colour:
+		rest = restPose.surfaceColor;
+		break;
+	case AnimationType::Radius:
+		rest = Vec3f(restPose.GetRadius(), 0, 0);
+		step = Vec3f(step.x / 100, 0, 0);
+		break;
+	case AnimationType::Reflection:
+		rest = Vec3f(restPose.reflection, 0, 0);
+		break;
+	case AnimationType::Transparency:
+		rest = Vec3f(restPose.transparency, 0, 0);
+		break;
+	default:
+		return;
+	}
+
+	// frame 0 shows one clamped step. A constant step never leaves a limit it reached
+	// or crosses one it did not, so clamping the line from there gives the same values
+	// as clamping after every step
+	Vec3f start = ClampToType((int)anim.aType, rest + step);
+	SetTrack(sphere, anim.aType, { 0.0f, 1.0f }, { start, start + step }, true);
+}
+
+void AnimationSystem::Evaluate(Sphere** spheres, const Sphere* restPose,
+	const unsigned int sphereNum, float frame)
+{
+	for (unsigned int i = 0; i < sphereNum; i++)
+		*spheres[i] = restPose[i];
+
+	// every track starts at its first key and each segment adds its part of the way
+	// to the next key, so all segments of a type are summed in one pass without
+	// looking for the current key
+	for (int t = 0; t < TRACK_TYPES; t++)
+	{
+		Vec3f* results = m_results[t].data();
+		const unsigned int* segTrack = m_segTrack[t].data();
+		const float* segStart = m_segStart[t].data();
+		const float* segInvSpan = m_segInvSpan[t].data();
+		const float* segMaxMix = m_segMaxMix[t].data();
+		const Vec3f* segDelta = m_segDelta[t].data();
+		const unsigned int segNum = (unsigned int)m_segTrack[t].size();
+
+		std::copy(m_trackStart[t].begin(), m_trackStart[t].end(), results);
+		for (unsigned int seg = 0; seg < segNum; seg++)
+		{
+			float mix = std::min(std::max((frame - segStart[seg]) * segInvSpan[seg], 0.0f), segMaxMix[seg]);
+			results[segTrack[seg]] += segDelta[seg] * mix;
+		}
+	}
+
+	for (int t = 0; t < TRACK_TYPES; t++)
+	{
+		for (unsigned int track = 0; track < m_trackSphere[t].size(); track++)
+		{
+			unsigned int i = m_trackSphere[t][track];
+			if (i >= sphereNum)
+				continue;
+
+			Vec3f v = ClampToType(t, m_results[t][track]);
+			switch ((AnimationType)t)
+			{
+			case AnimationType::Position:
+				spheres[i]->SetPosition(v);
+				break;
+			case AnimationType::Colour:
+				spheres[i]->SetSurfaceColor(v);
+				break;
+			case AnimationType::Radius:
+				spheres[i]->SetRadius(v.x);
+				break;
+			case AnimationType::Reflection:
+				spheres[i]->reflection = v.x;
+				break;
+			case AnimationType::Transparency:
+				spheres[i]->transparency = v.x;
+				break;
+			default:
+				break;
+			}
+		}
+	}
+}
+
+void AnimationSystem::ReadFromJson(const json& j, unsigned int sphere)
+{
+	if (!j.contains("keyframes"))
+		return;
+
+	const json& keyframes = j.at("keyframes");
+	for (int t = 0; t < TRACK_TYPES; t++)
+	{
+		if (!keyframes.contains(TRACK_NAMES[t]))
+			continue;
+
+		std::vector<float> frames;
+		std::vector<Vec3f> values;
+		for (const json& key : keyframes.at(TRACK_NAMES[t]))
+		{
+			Vec3f v;
+			if (IsVectorTrack(t))
+			{
+				key.at("x").get_to(v.x);
+				key.at("y").get_to(v.y);
+				key.at("z").get_to(v.z);
+			}
+			else
+				key.at("value").get_to(v.x);
+
+			frames.push_back(key.at("frame").get<float>());
+			values.push_back(v);
+		}
+		bool extrapolate = keyframes.contains("extrapolate") &&
+			std::find(keyframes.at("extrapolate").begin(), keyframes.at("extrapolate").end(),
+				TRACK_NAMES[t]) != keyframes.at("extrapolate").end();
+		SetTrack(sphere, (AnimationType)t, frames, values, extrapolate);
+	}
+}
+
+void AnimationSystem::WriteToJson(json& j, unsigned int sphere) const
+{
+	json keyframes = json::object();
+	json extrapolate = json::array();
+	for (int t = 0; t < TRACK_TYPES; t++)
+	{
+		for (unsigned int track = 0; track < m_trackSphere[t].size(); track++)
+		{
+			if (m_trackSphere[t][track] != sphere)
+				continue;
+
+			json keys = json::array();
+			for (unsigned int k = m_firstKey[t][track]; k < m_firstKey[t][track] + m_keyNum[t][track]; k++)
+			{
+				const Vec3f& v = m_keyValues[t][k];
+				if (IsVectorTrack(t))
+					keys.push_back(json{ {"frame", m_keyFrames[t][k]}, {"x", v.x}, {"y", v.y}, {"z", v.z} });
+				else
+					keys.push_back(json{ {"frame", m_keyFrames[t][k]}, {"value", v.x} });
+			}
+			keyframes[TRACK_NAMES[t]] = keys;
+			if (m_extrapolate[t][track])
+				extrapolate.push_back(TRACK_NAMES[t]);
+		}
+	}
+
+	if (!extrapolate.empty())
+		keyframes["extrapolate"] = extrapolate;
+	if (!keyframes.empty())
+		j["keyframes"] = keyframes;
+}
+
+AnimationSystem* AnimationSystem::GetInstance()
+{
+	if (m_instance == 0)
+		m_instance = new AnimationSystem();
+	return m_instance;
+}
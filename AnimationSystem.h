@@ -0,0 +1,74 @@
+#ifndef ANIMATIONSYSTEM_H
+#define ANIMATIONSYSTEM_H
+
+#include <vector>
+#include "Commons.h"
+#include "Sphere.h"
+#include "json.hpp"
+
+// Keyframe animation for every sphere of the scene. A sphere can have one track
+// per AnimationType, all tracks run at the same time. The keys of every track of a
+// type are baked into flat arrays of segments, a frame is evaluated for every sphere
+// in one pass without branching on the keys.
+class AnimationSystem
+{
+public:
+	AnimationSystem();
+	~AnimationSystem();
+
+	void Clear();
+	bool HasTracks() const;
+
+	// Replaces the track of this type for the sphere, frames have to be ascending.
+	// Scalar tracks (radius, reflection, transparency) only use value.x. The track
+	// holds its last value after the last key, or keeps the slope of its last
+	// segment when extrapolate is set
+	void SetTrack(unsigned int sphere, AnimationType type,
+		const std::vector<float>& frames, const std::vector<Vec3f>& values,
+		bool extrapolate = false);
+
+	// Turns an animation that changes by changeTo every frame into a track that
+	// extrapolates from the rest pose, frame n shows n + 1 steps like the old
+	// per-frame stepping did
+	void AddAnimation(unsigned int sphere, const Sphere& restPose, const Animation& anim);
+
+	// Sets every sphere to its rest pose with all tracks evaluated at frame
+	void Evaluate(Sphere** spheres, const Sphere* restPose,
+		const unsigned int sphereNum, float frame);
+
+	void ReadFromJson(const nlohmann::json& j, unsigned int sphere);
+	void WriteToJson(nlohmann::json& j, unsigned int sphere) const;
+
+	static AnimationSystem* GetInstance();
+
+private:
+	static AnimationSystem* m_instance;
+
+	static constexpr int TRACK_TYPES = (int)AnimationType::Max;
+
+	// Rebuilds the segments of every track of the type from its keys
+	void BuildSegments(int type);
+
+	// One entry per track
+	std::vector<unsigned int> m_trackSphere[TRACK_TYPES];
+	std::vector<unsigned int> m_firstKey[TRACK_TYPES];
+	std::vector<unsigned int> m_keyNum[TRACK_TYPES];
+	std::vector<bool> m_extrapolate[TRACK_TYPES];
+	// Value of the first key, the segments add onto it
+	std::vector<Vec3f> m_trackStart[TRACK_TYPES];
+	std::vector<Vec3f> m_results[TRACK_TYPES];
+
+	// One entry per key
+	std::vector<float> m_keyFrames[TRACK_TYPES];
+	std::vector<Vec3f> m_keyValues[TRACK_TYPES];
+
+	// One entry per pair of neighbouring keys. A segment adds
+	// delta * clamp((frame - start) * invSpan, 0, maxMix) to its track, maxMix is 1
+	// unless the track extrapolates past its last key
+	std::vector<unsigned int> m_segTrack[TRACK_TYPES];
+	std::vector<float> m_segStart[TRACK_TYPES];
+	std::vector<float> m_segInvSpan[TRACK_TYPES];
+	std::vector<float> m_segMaxMix[TRACK_TYPES];
+	std::vector<Vec3f> m_segDelta[TRACK_TYPES];
+};
+#endif
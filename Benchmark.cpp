@@ -0,0 +1,448 @@
+#include "Benchmark.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "AnimationSystem.h"
+#include "NumaTopology.h"
+#include "PerfCounters.h"
+#include "Renderer.h"
+#include "SceneSnapshot.h"
+#include "TileCuller.h"
+#include "VisibilityBuffer.h"
+#include "WavefrontRenderer.h"
+
+namespace
+{
+	const int BENCHMARK_RUNS = 3;
+	// Animation updates and snapshots timed by the sphere data benchmark
+	const int SCENE_UPDATES = 100000;
+
+	// Best of BENCHMARK_RUNS renders of a whole frame, in milliseconds
+	double TimeRender(const SceneSnapshot& scene, const Camera* camera, Vec3f* image, FrameStats* stats = nullptr)
+	{
+		double best = 0;
+		for (int run = 0; run < BENCHMARK_RUNS; run++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			RenderScreenQuad(0, gHeight, image, &scene, camera, run == 0 ? stats : nullptr);
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			if (run == 0 || elapsed.count() < best)
+				best = elapsed.count();
+		}
+		return best;
+	}
+
+	// Compares the images as they would be written to the PPM files, returns the PSNR
+	// (INFINITY if they are the same)
+	double CompareImages(const Vec3f* reference, const Vec3f* image)
+	{
+		unsigned int differentBytes = 0, maxDifference = 0;
+		double squaredError = 0;
+		for (unsigned i = 0; i < gWidth * gHeight; ++i)
+		{
+			const float a[3] = { reference[i].x, reference[i].y, reference[i].z };
+			const float b[3] = { image[i].x, image[i].y, image[i].z };
+			for (int c = 0; c < 3; c++)
+			{
+				int difference = abs((int)(unsigned char)(std::min(float(1), a[c]) * 255) -
+					(int)(unsigned char)(std::min(float(1), b[c]) * 255));
+				if (difference == 0)
+					continue;
+				differentBytes++;
+				maxDifference = std::max(maxDifference, (unsigned int)difference);
+				squaredError += difference * difference;
+			}
+		}
+
+		double psnr = INFINITY;
+		std::cout << "  bytes different from reference: " << differentBytes <<
+			", max difference: " << maxDifference;
+		if (differentBytes > 0)
+		{
+			psnr = 10 * log10(255.0 * 255.0 / (squaredError / (gWidth * gHeight * 3)));
+			std::cout << ", PSNR: " << psnr << " dB";
+		}
+		std::cout << std::endl;
+		return psnr;
+	}
+
+	void BenchmarkTraceModes(const SceneSnapshot& scene, const Camera* camera)
+	{
+		const RenderSettings savedSettings = gRenderSettings;
+		Vec3f* reference = new Vec3f[gWidth * gHeight];
+		Vec3f* image = new Vec3f[gWidth * gHeight];
+
+		// the fast math kernel or the wavefront renderer would replace the kernel under test
+		gRenderSettings.wavefront = false;
+		gRenderSettings.fastMath = false;
+		gRenderSettings.traceMode = TraceMode::Recursive;
+		double recursive = TimeRender(scene, camera, reference);
+		std::cout << "Recursive Trace: " << recursive << " ms" << std::endl;
+
+		gRenderSettings.traceMode = TraceMode::Iterative;
+		double iterative = TimeRender(scene, camera, image);
+		std::cout << "Iterative Trace: " << iterative << " ms (" << recursive / iterative << "x)" << std::endl;
+		CompareImages(reference, image);
+
+		gRenderSettings.traceMode = TraceMode::Unrolled;
+		double unrolled = TimeRender(scene, camera, image);
+		std::cout << "Unrolled Trace (depth " << gRenderSettings.maxDepth << "): " << unrolled <<
+			" ms (" << recursive / unrolled << "x)" << std::endl;
+		CompareImages(reference, image);
+
+		gRenderSettings = savedSettings;
+		delete[] reference;
+		delete[] image;
+	}
+
+	void BenchmarkWavefront(const SceneSnapshot& scene, const Camera* camera)
+	{
+		const RenderSettings savedSettings = gRenderSettings;
+		Vec3f* reference = new Vec3f[gWidth * gHeight];
+		Vec3f* image = new Vec3f[gWidth * gHeight];
+		// the wavefront renderer has no fast math kernel, compare like with like
+		gRenderSettings.fastMath = false;
+
+		// both paths trace the same ray tree, so the wavefront count is valid for both
+		WavefrontRenderer wavefront;
+		wavefront.Render(0, gHeight, image, &scene, camera);
+		double rays = (double)wavefront.GetRayCount();
+		std::cout << "Rays per frame: " << rays << std::endl;
+
+		gRenderSettings.wavefront = false;
+		double perPixel = TimeRender(scene, camera, reference);
+		std::cout << "Per pixel: " << perPixel << " ms, " << rays / perPixel / 1000 << " Mrays/s" << std::endl;
+
+		gRenderSettings.wavefront = true;
+		double sorted = TimeRender(scene, camera, image);
+		std::cout << "Wavefront: " << sorted << " ms, " << rays / sorted / 1000 << " Mrays/s" << std::endl;
+		CompareImages(reference, image);
+
+		gRenderSettings = savedSettings;
+		delete[] reference;
+		delete[] image;
+	}
+
+	void BenchmarkFastMath(const SceneSnapshot& scene, const Camera* camera)
+	{
+#if FAST_MATH_KERNEL
+		const RenderSettings savedSettings = gRenderSettings;
+		Vec3f* reference = new Vec3f[gWidth * gHeight];
+		Vec3f* image = new Vec3f[gWidth * gHeight];
+
+		// the reference is the kernel the fast one replaces
+		gRenderSettings.traceMode = TraceMode::Iterative;
+		gRenderSettings.wavefront = false;
+		gRenderSettings.fastMath = false;
+		double precise = TimeRender(scene, camera, reference);
+		std::cout << "Reference kernel: " << precise << " ms" << std::endl;
+
+		gRenderSettings.fastMath = true;
+		double fast = TimeRender(scene, camera, image);
+		std::cout << "Fast math kernel: " << fast << " ms (" << precise / fast << "x)" << std::endl;
+		double psnr = CompareImages(reference, image);
+		std::cout << "  accuracy " << (psnr >= FAST_MATH_MIN_PSNR ? "passed" : "FAILED") <<
+			" (at least " << FAST_MATH_MIN_PSNR << " dB)" << std::endl;
+
+		gRenderSettings = savedSettings;
+		delete[] reference;
+		delete[] image;
+#else
+		std::cout << "Built without the fast math kernel" << std::endl;
+#endif
+	}
+
+	void BenchmarkTileCulling(const SceneSnapshot& scene, const Camera* camera)
+	{
+		const RenderSettings savedSettings = gRenderSettings;
+		Vec3f* reference = new Vec3f[gWidth * gHeight];
+		Vec3f* image = new Vec3f[gWidth * gHeight];
+
+		TileCuller culler;
+		culler.Build(scene, *camera, 0, gHeight);
+		std::cout << "Spheres per tile: " << culler.GetAverageSphereNum() << " of " <<
+			scene.GetSphereNum() << std::endl;
+
+		gRenderSettings.wavefront = false;
+		gRenderSettings.tileCulling = false;
+		double all = TimeRender(scene, camera, reference);
+		std::cout << "Without culling: " << all << " ms" << std::endl;
+
+		gRenderSettings.tileCulling = true;
+		double culled = TimeRender(scene, camera, image);
+		std::cout << "With tile culling: " << culled << " ms (" << all / culled << "x)" << std::endl;
+		CompareImages(reference, image);
+
+		gRenderSettings = savedSettings;
+		delete[] reference;
+		delete[] image;
+	}
+
+	void BenchmarkVisibilityBuffer(const SceneSnapshot& scene, const Camera* camera)
+	{
+		const RenderSettings savedSettings = gRenderSettings;
+		Vec3f* reference = new Vec3f[gWidth * gHeight];
+		Vec3f* image = new Vec3f[gWidth * gHeight];
+
+		VisibilityBuffer visibility;
+		auto start = std::chrono::steady_clock::now();
+		visibility.Build(scene, *camera, 0, gHeight);
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		std::cout << "Rasterising: " << elapsed.count() << " ms, " << visibility.GetCoverage() * 100 <<
+			"% of the pixels covered" << std::endl;
+
+		gRenderSettings.wavefront = false;
+		gRenderSettings.visibilityBuffer = false;
+		gRenderSettings.tileCulling = false;
+		double traced = TimeRender(scene, camera, reference);
+		std::cout << "Traced camera rays: " << traced << " ms" << std::endl;
+
+		gRenderSettings.tileCulling = true;
+		double culled = TimeRender(scene, camera, image);
+		std::cout << "With tile culling: " << culled << " ms (" << traced / culled << "x)" << std::endl;
+		CompareImages(reference, image);
+
+		gRenderSettings.visibilityBuffer = true;
+		double raster = TimeRender(scene, camera, image);
+		std::cout << "Rasterised camera rays: " << raster << " ms (" << traced / raster << "x)" << std::endl;
+		CompareImages(reference, image);
+
+		gRenderSettings = savedSettings;
+		delete[] reference;
+		delete[] image;
+	}
+
+	// Best of BENCHMARK_RUNS renders with one thread per CPU of the first nodeNum NUMA
+	// nodes, each on its own band of rows. The image is allocated again for every run
+	// so its pages are first touched by the render threads
+	double TimeNodeRender(const std::shared_ptr<const SceneSnapshot>& scene, const Camera* camera, unsigned int nodeNum, bool pin)
+	{
+		NumaTopology* numa = NumaTopology::GetInstance();
+		std::vector<int> threadNodes;
+		for (unsigned int node = 0; node < nodeNum; node++)
+			threadNodes.insert(threadNodes.end(), numa->GetCpus(node).size(), node);
+		const unsigned int threadNum = (unsigned int)threadNodes.size();
+
+		double best = 0;
+		for (int run = 0; run < BENCHMARK_RUNS; run++)
+		{
+			Vec3f* image = (Vec3f*)::operator new(sizeof(Vec3f) * gWidth * gHeight);
+			auto start = std::chrono::steady_clock::now();
+			std::vector<std::thread> threads;
+			for (unsigned int i = 0; i < threadNum; i++)
+			{
+				unsigned int startRow = gHeight * i / threadNum, endRow = gHeight * (i + 1) / threadNum;
+				threads.push_back(std::thread(RenderScreenQuadOnNode, pin ? threadNodes[i] : -1,
+					startRow, endRow, image + startRow * gWidth, scene, camera, nullptr));
+			}
+			for (std::thread& thread : threads)
+				thread.join();
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			if (run == 0 || elapsed.count() < best)
+				best = elapsed.count();
+			::operator delete(image);
+		}
+		return best;
+	}
+
+	void BenchmarkNuma(const std::shared_ptr<const SceneSnapshot>& scene, const Camera* camera)
+	{
+		NumaTopology* numa = NumaTopology::GetInstance();
+		std::cout << "NUMA nodes: " << numa->GetNodeNum() << ", CPUs: " << numa->GetCpuNum() << std::endl;
+
+		double firstNode = 0;
+		for (unsigned int nodeNum = 1; nodeNum <= numa->GetNodeNum(); nodeNum++)
+		{
+			double floating = TimeNodeRender(scene, camera, nodeNum, false);
+			double pinned = TimeNodeRender(scene, camera, nodeNum, true);
+			if (nodeNum == 1)
+				firstNode = pinned;
+			std::cout << nodeNum << " node(s): unpinned " << floating << " ms, pinned " << pinned <<
+				" ms (" << firstNode / pinned << "x of one node)" << std::endl;
+		}
+	}
+
+	void PrintCounters(const PerfCounters& counters)
+	{
+		for (int c = 0; c < PerfCounters::COUNTER_NUM; c++)
+		{
+			PerfCounters::Counter counter = (PerfCounters::Counter)c;
+			std::cout << "  " << PerfCounters::GetName(counter) << ": ";
+			if (counters.IsAvailable(counter))
+				std::cout << counters.Get(counter) << std::endl;
+			else
+				std::cout << "not available on this system" << std::endl;
+		}
+	}
+
+	// Cache misses of the two places reading the scene every frame: the per frame
+	// update of the pool spheres (animation and snapshot) and the render itself
+	void BenchmarkSphereData(Sphere** spheres, const unsigned int allocatedNum,
+		const SceneSnapshot& scene, const Camera* camera)
+	{
+		std::cout << "Sphere: " << sizeof(Sphere) << " bytes, snapshot geometry: " <<
+			sizeof(SceneSnapshot::SphereGeometry) << " bytes per sphere" << std::endl;
+
+		std::vector<Sphere> restPose;
+		for (unsigned int i = 0; i < allocatedNum; i++)
+			restPose.push_back(*spheres[i]);
+
+		PerfCounters counters;
+		std::shared_ptr<const SceneSnapshot> snapshot = SceneSnapshot::Create(spheres, allocatedNum);
+		auto start = std::chrono::steady_clock::now();
+		counters.Start();
+		for (int update = 0; update < SCENE_UPDATES; update++)
+		{
+			AnimationSystem::GetInstance()->Evaluate(spheres, restPose.data(), allocatedNum, (float)update);
+			snapshot = SceneSnapshot::Create(spheres, allocatedNum, snapshot);
+		}
+		counters.Stop();
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		std::cout << SCENE_UPDATES << " scene updates: " << elapsed.count() << " ms" << std::endl;
+		PrintCounters(counters);
+
+		// leave the pool as it was
+		for (unsigned int i = 0; i < allocatedNum; i++)
+			*spheres[i] = restPose[i];
+
+		Vec3f* image = new Vec3f[gWidth * gHeight];
+		start = std::chrono::steady_clock::now();
+		counters.Start();
+		RenderScreenQuad(0, gHeight, image, &scene, camera);
+		counters.Stop();
+		elapsed = std::chrono::steady_clock::now() - start;
+		std::cout << "Frame: " << elapsed.count() << " ms" << std::endl;
+		PrintCounters(counters);
+		delete[] image;
+	}
+
+	// Time and cache counters of one frame per pixel order, with and without tile culling
+	void BenchmarkPixelOrder(const SceneSnapshot& scene, const Camera* camera)
+	{
+		const RenderSettings savedSettings = gRenderSettings;
+		Vec3f* reference = new Vec3f[gWidth * gHeight];
+		Vec3f* image = new Vec3f[gWidth * gHeight];
+
+		gRenderSettings.wavefront = false;
+		for (int culling = 1; culling >= 0; culling--)
+		{
+			gRenderSettings.tileCulling = culling == 1;
+			std::cout << (culling ? "With tile culling" : "Without tile culling") << std::endl;
+
+			double scanline = 0;
+			for (int order = 0; order < (int)PixelOrder::Max; order++)
+			{
+				gRenderSettings.pixelOrder = (PixelOrder)order;
+				Vec3f* target = order == 0 ? reference : image;
+				double time = TimeRender(scene, camera, target);
+				if (order == 0)
+					scanline = time;
+				std::cout << GetPixelOrderName((PixelOrder)order) << ": " << time << " ms (" <<
+					scanline / time << "x)" << std::endl;
+
+				PerfCounters counters;
+				counters.Start();
+				RenderScreenQuad(0, gHeight, target, &scene, camera);
+				counters.Stop();
+				PrintCounters(counters);
+				if (order > 0)
+					CompareImages(reference, image);
+			}
+		}
+
+		gRenderSettings = savedSettings;
+		delete[] reference;
+		delete[] image;
+	}
+
+	void BenchmarkPruning(const SceneSnapshot& scene, const Camera* camera)
+	{
+		const RenderSettings savedSettings = gRenderSettings;
+		Vec3f* reference = new Vec3f[gWidth * gHeight];
+		Vec3f* image = new Vec3f[gWidth * gHeight];
+
+		// of the per pixel kernels only the iterative one prunes, the others would time
+		// the whole ray tree every run
+		gRenderSettings.traceMode = TraceMode::Iterative;
+		gRenderSettings.wavefront = false;
+		gRenderSettings.fastMath = false;
+		gRenderSettings.pruneEpsilon = 0;
+		double unpruned = TimeRender(scene, camera, reference);
+		std::cout << "Without pruning: " << unpruned << " ms" << std::endl;
+
+		// the configured epsilon first, then a sweep
+		const float epsilons[] = { savedSettings.pruneEpsilon, 0.001f, 0.01f, 0.05f, 0.1f };
+		for (float epsilon : epsilons)
+		{
+			if (epsilon <= 0)
+				continue;
+
+			for (int roulette = 0; roulette < 2; roulette++)
+			{
+				gRenderSettings.pruneEpsilon = epsilon;
+				gRenderSettings.russianRoulette = roulette == 1;
+				FrameStats stats;
+				double pruned = TimeRender(scene, camera, image, &stats);
+				std::cout << "Epsilon " << epsilon << (roulette ? " with roulette: " : ": ") << pruned <<
+					" ms (" << unpruned / pruned << "x), " << stats.prunedRays << " rays pruned" << std::endl;
+				CompareImages(reference, image);
+			}
+		}
+
+		gRenderSettings = savedSettings;
+		delete[] reference;
+		delete[] image;
+	}
+}
+
+void RunBenchmarks(Sphere** spheres, const unsigned int allocatedNum, const Camera* camera)
+{
+	std::shared_ptr<const SceneSnapshot> scene = SceneSnapshot::Create(spheres, allocatedNum);
+
+	std::cout << "Choose a benchmark:" << "\n" <<
+		"1. Recursive vs iterative vs unrolled Trace" << "\n" <<
+		"2. Per pixel vs wavefront rays/s" << "\n" <<
+		"3. Secondary ray pruning" << "\n" <<
+		"4. Fast math kernel accuracy" << "\n" <<
+		"5. Sphere data cache misses" << "\n" <<
+		"6. Per tile sphere culling" << "\n" <<
+		"7. Rasterised primary visibility" << "\n" <<
+		"8. NUMA node scaling" << "\n" <<
+		"9. Scanline vs Morton vs Hilbert pixel order" << std::endl;
+
+	int benchmark;
+	std::cin >> benchmark;
+	switch (benchmark)
+	{
+	case 1:
+		BenchmarkTraceModes(*scene, camera);
+		break;
+	case 2:
+		BenchmarkWavefront(*scene, camera);
+		break;
+	case 3:
+		BenchmarkPruning(*scene, camera);
+		break;
+	case 4:
+		BenchmarkFastMath(*scene, camera);
+		break;
+	case 5:
+		BenchmarkSphereData(spheres, allocatedNum, *scene, camera);
+		break;
+	case 6:
+		BenchmarkTileCulling(*scene, camera);
+		break;
+	case 7:
+		BenchmarkVisibilityBuffer(*scene, camera);
+		break;
+	case 8:
+		BenchmarkNuma(scene, camera);
+		break;
+	case 9:
+		BenchmarkPixelOrder(*scene, camera);
+		break;
+	default:
+		std::cout << "No benchmark" << std::endl;
+	}
+}
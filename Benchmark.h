@@ -0,0 +1,11 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "Camera.h"
+#include "Commons.h"
+#include "Sphere.h"
+
+// Renders the current scene in memory with different render settings and
+// prints the timings and how far the images are from the reference.
+void RunBenchmarks(Sphere** spheres, const unsigned int allocatedNum, const Camera* camera);
+#endif
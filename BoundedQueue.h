@@ -0,0 +1,52 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Queue between two threads holding at most capacity items: Push waits while it is
+// full and Pop while it is empty, so a fast producer can not run ahead of its consumer
+template<typename T>
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue(size_t capacity) : m_capacity(capacity), m_closed(false) {}
+
+	void Push(T item)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notFull.wait(lock, [this]() { return m_items.size() < m_capacity; });
+		m_items.push_back(std::move(item));
+		m_notEmpty.notify_one();
+	}
+
+	// False once the queue is closed and empty
+	bool Pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notEmpty.wait(lock, [this]() { return !m_items.empty() || m_closed; });
+		if (m_items.empty())
+			return false;
+		item = std::move(m_items.front());
+		m_items.pop_front();
+		m_notFull.notify_one();
+		return true;
+	}
+
+	// No more items will be pushed
+	void Close()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_closed = true;
+		m_notEmpty.notify_all();
+	}
+
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_notFull, m_notEmpty;
+	std::deque<T> m_items;
+	size_t m_capacity;
+	bool m_closed;
+};
+#endif
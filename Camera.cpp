@@ -0,0 +1,24 @@
+#include "Camera.h"
+#include "Renderer.h"
+
+Camera::Camera(unsigned int width, unsigned int height, float fov)
+	: m_width(width), m_height(height), m_fov(fov)
+{
+	// same arithmetic the per pixel code used, so the rays are bit for bit the same
+	float invWidth = 1 / float(width), invHeight = 1 / float(height);
+	float aspectRatio = width / float(height);
+	float angle = tan(M_PI * 0.5 * fov / 180.);
+
+	unsigned int paddedWidth = (width + CAMERA_PACKET_WIDTH - 1) / CAMERA_PACKET_WIDTH * CAMERA_PACKET_WIDTH;
+	m_columnDirection.resize(paddedWidth);
+	for (unsigned int x = 0; x < paddedWidth; ++x)
+		m_columnDirection[x] = (2 * ((x + 0.5) * invWidth) - 1) * angle * aspectRatio;
+
+	m_rowDirection.resize(height);
+	for (unsigned int y = 0; y < height; ++y)
+		m_rowDirection[y] = (1 - 2 * ((y + 0.5) * invHeight)) * angle;
+}
+
+Camera::~Camera()
+{
+}
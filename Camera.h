@@ -0,0 +1,43 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include <vector>
+#include "Commons.h"
+
+// Columns traced together by packet code, the direction tables are padded to a multiple of it
+#define CAMERA_PACKET_WIDTH 8
+
+// Pinhole camera at the origin looking down -z. The camera ray of pixel (x, y) is
+// (columnDirection[x], rowDirection[y], -1) normalised, so instead of redoing the
+// double precision math for every pixel of every frame both components are computed
+// once per resolution and field of view and kept in two contiguous float arrays.
+class Camera
+{
+public:
+	Camera(unsigned int width, unsigned int height, float fov = 30);
+	~Camera();
+
+	unsigned int GetWidth() const { return m_width; }
+	unsigned int GetHeight() const { return m_height; }
+	float GetFov() const { return m_fov; }
+
+	// Unnormalised x direction per column (padded past the width) and y direction per row
+	const float* GetColumnDirections() const { return m_columnDirection.data(); }
+	const float* GetRowDirections() const { return m_rowDirection.data(); }
+
+	// Normalised camera ray of a pixel
+	Vec3f GetRayDirection(unsigned int x, unsigned int y) const
+	{
+		Vec3f raydir(m_columnDirection[x], m_rowDirection[y], -1);
+		raydir.normalize();
+		return raydir;
+	}
+
+private:
+	unsigned int m_width, m_height;
+	float m_fov;
+
+	std::vector<float> m_columnDirection;
+	std::vector<float> m_rowDirection;
+};
+#endif
@@ -4,6 +4,8 @@
 #include <fstream>
 #include <iostream>
 #include <algorithm>
+#include <atomic>
+#include <cmath>
 
 template<typename T>
 class Vec3
@@ -66,6 +68,8 @@ enum class AnimationType
 	Position = 0,
 	Colour,
 	Radius,
+	Reflection,
+	Transparency,
 	Max
 };
 
@@ -113,17 +117,19 @@ struct Animation
 struct Header;
 struct Heap
 {
-	size_t allocatedSize;
+	// the render workers allocate too, so the count is atomic
+	std::atomic<size_t> allocatedSize;
+	// only kept with gUseDoubleLinkedList, which is not thread safe
 	Header* pLastAssigned;
 
 	void Init()
 	{
-		this->allocatedSize = 0;
+		this->allocatedSize.store(0);
 		this->pLastAssigned = nullptr;
 	}
 
-	void Increase(size_t size) { allocatedSize += size; }
-	void Decrease(size_t size) { allocatedSize -= size; }
+	void Increase(size_t size) { allocatedSize.fetch_add(size, std::memory_order_relaxed); }
+	void Decrease(size_t size) { allocatedSize.fetch_sub(size, std::memory_order_relaxed); }
 };
 
 struct Header
@@ -0,0 +1,128 @@
+#include "CpuLimits.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace
+{
+#ifdef __linux__
+	// Quota / period of a cgroup v1 cpu directory, 0 without a quota
+	double ReadQuotaV1(const std::string& directory)
+	{
+		std::ifstream quotaFile(directory + "/cpu.cfs_quota_us"), periodFile(directory + "/cpu.cfs_period_us");
+		long long quota = -1, period = 0;
+		if (!(quotaFile >> quota) || !(periodFile >> period) || quota <= 0 || period <= 0)
+			return 0;
+		return (double)quota / period;
+	}
+
+	// Same for the cpu.max of a cgroup v2 directory, "max <period>" is no quota
+	double ReadQuotaV2(const std::string& directory)
+	{
+		std::ifstream file(directory + "/cpu.max");
+		std::string quota;
+		long long period = 0;
+		if (!(file >> quota >> period) || quota == "max" || period <= 0)
+			return 0;
+		long long value = atoll(quota.c_str());
+		return value > 0 ? (double)value / period : 0;
+	}
+
+	// Keeps the tighter of two quotas, 0 meaning none
+	double MinQuota(double a, double b)
+	{
+		if (a <= 0)
+			return b;
+		if (b <= 0)
+			return a;
+		return std::min(a, b);
+	}
+
+	// Quota of the process's cgroup and every parent up to the mount point
+	double ReadCgroupQuota()
+	{
+		double quota = 0;
+		std::ifstream cgroups("/proc/self/cgroup");
+		std::string line;
+		while (std::getline(cgroups, line))
+		{
+			// "<id>:<controllers>:<path>", v2 is id 0 without controllers
+			size_t first = line.find(':'), second = line.find(':', first + 1);
+			if (first == std::string::npos || second == std::string::npos)
+				continue;
+			std::string controllers = line.substr(first + 1, second - first - 1);
+			std::string path = line.substr(second + 1);
+			if (path == "/")
+				path.clear();
+
+			if (controllers.empty())
+			{
+				while (true)
+				{
+					quota = MinQuota(quota, ReadQuotaV2("/sys/fs/cgroup" + path));
+					if (path.empty())
+						break;
+					path = path.substr(0, path.rfind('/'));
+				}
+				continue;
+			}
+
+			bool cpu = false;
+			std::stringstream ss(controllers);
+			std::string controller;
+			while (std::getline(ss, controller, ','))
+				cpu = cpu || controller == "cpu";
+			if (!cpu)
+				continue;
+
+			// the cpu hierarchy is mounted under one of these names
+			const char* mounts[] = { "/sys/fs/cgroup/cpu", "/sys/fs/cgroup/cpu,cpuacct", "/sys/fs/cgroup/cpuacct,cpu" };
+			for (const char* mount : mounts)
+			{
+				std::string directory = path;
+				while (true)
+				{
+					quota = MinQuota(quota, ReadQuotaV1(mount + directory));
+					if (directory.empty())
+						break;
+					directory = directory.substr(0, directory.rfind('/'));
+				}
+			}
+		}
+		return quota;
+	}
+#endif
+}
+
+unsigned int CpuLimits::GetWorkerNum() const
+{
+	unsigned int workers = std::min(hardwareThreads, affinityCpus);
+	if (quotaCpus > 0)
+		workers = std::min(workers, (unsigned int)std::ceil(quotaCpus));
+	return std::max(workers, 1u);
+}
+
+CpuLimits DetectCpuLimits()
+{
+	CpuLimits limits;
+	limits.hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	limits.affinityCpus = limits.hardwareThreads;
+	limits.quotaCpus = 0;
+
+#ifdef __linux__
+	cpu_set_t set;
+	if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0)
+		limits.affinityCpus = (unsigned int)CPU_COUNT(&set);
+	limits.quotaCpus = ReadCgroupQuota();
+#endif
+	return limits;
+}
@@ -0,0 +1,23 @@
+#ifndef CPULIMITS_H
+#define CPULIMITS_H
+
+// How many CPUs this process may actually use. hardware_concurrency counts every
+// CPU of the machine, a container usually gets less: an affinity mask (cpuset) and
+// a CFS quota (cgroup v1 cpu.cfs_quota_us or v2 cpu.max) that throttles the whole
+// process once its threads used quota / period CPUs worth of time.
+struct CpuLimits
+{
+	unsigned int hardwareThreads;
+	// CPUs in the affinity mask, hardwareThreads where that is not known
+	unsigned int affinityCpus;
+	// CPUs worth of time the cgroup quota allows, 0 if there is no quota
+	double quotaCpus;
+
+	// Render workers to start by default: the smallest of the above, a fractional
+	// quota rounded up so the last worker can use the remainder
+	unsigned int GetWorkerNum() const;
+};
+
+// Reads the limits of the calling process (Linux), elsewhere only hardwareThreads
+CpuLimits DetectCpuLimits();
+#endif
@@ -0,0 +1,48 @@
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+#include <string.h>
+#include "Commons.h"
+
+#if defined __SSE__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FAST_MATH_SSE 1
+#endif
+
+// Float only replacements for the double math of the trace kernels, used by the
+// fast math kernel (see FAST_MATH_KERNEL in Renderer.h)
+
+// 1 / sqrt(x) from a hardware (or bit trick) estimate refined by Newton-Raphson
+inline float FastRsqrt(float x)
+{
+#ifdef FAST_MATH_SSE
+	float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+#else
+	int i;
+	float y;
+	memcpy(&i, &x, sizeof(float));
+	i = 0x5f3759df - (i >> 1);
+	memcpy(&y, &i, sizeof(float));
+	y = y * (1.5f - 0.5f * x * y * y);
+#endif
+	return y * (1.5f - 0.5f * x * y * y);
+}
+
+inline Vec3f& FastNormalize(Vec3f& v)
+{
+	float nor2 = v.length2();
+	if (nor2 > 0)
+	{
+		float invNor = FastRsqrt(nor2);
+		v.x *= invNor, v.y *= invNor, v.z *= invNor;
+	}
+	return v;
+}
+
+// Mix(pow(1 - facingratio, 3), 1, 0.1) as a float polynomial
+inline float FastFresnel(float facingratio)
+{
+	float c = 1 - facingratio;
+	return 0.1f + 0.9f * (c * c * c);
+}
+#endif
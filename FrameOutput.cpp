@@ -0,0 +1,31 @@
+#include "FrameOutput.h"
+
+#include <sstream>
+
+std::string GetFramePath(const std::string& prefix, int frame)
+{
+	std::stringstream ss;
+	ss << prefix << frame << ".ppm";
+	return ss.str();
+}
+
+void QuantiseFrame(const Vec3f* image, unsigned int pixelNum, unsigned char* bytes)
+{
+	for (unsigned int i = 0; i < pixelNum; ++i)
+	{
+		bytes[i * 3] = (unsigned char)(std::min(float(1), image[i].x) * 255);
+		bytes[i * 3 + 1] = (unsigned char)(std::min(float(1), image[i].y) * 255);
+		bytes[i * 3 + 2] = (unsigned char)(std::min(float(1), image[i].z) * 255);
+	}
+}
+
+bool WritePPM(const std::string& filename, const unsigned char* bytes,
+	unsigned int width, unsigned int height)
+{
+	// keep these flags if you compile under Windows
+	std::ofstream ofs(filename, std::ios::out | std::ios::binary);
+	ofs << "P6\n" << width << " " << height << "\n255\n";
+	ofs.write((const char*)bytes, (std::streamsize)width * height * 3);
+	ofs.close();
+	return !ofs.fail();
+}
@@ -0,0 +1,16 @@
+#ifndef FRAMEOUTPUT_H
+#define FRAMEOUTPUT_H
+
+#include <string>
+#include "Commons.h"
+
+// Path of a frame file, <prefix><frame>.ppm
+std::string GetFramePath(const std::string& prefix, int frame);
+
+// Converts the colours to the 8 bit RGB bytes of the PPM file, 3 per pixel
+void QuantiseFrame(const Vec3f* image, unsigned int pixelNum, unsigned char* bytes);
+
+// Writes quantised pixels as a binary PPM, returns false if the file could not be written
+bool WritePPM(const std::string& filename, const unsigned char* bytes,
+	unsigned int width, unsigned int height);
+#endif
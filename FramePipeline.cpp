@@ -0,0 +1,216 @@
+#include "FramePipeline.h"
+
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <vector>
+#include "AnimationSystem.h"
+#include "FrameOutput.h"
+
+namespace
+{
+	typedef std::chrono::duration<double, std::milli> Milliseconds;
+}
+
+FramePipeline::FramePipeline(const Camera* camera, TaskScheduler* scheduler, unsigned int queueSize,
+	unsigned int framesInFlight) :
+	m_camera(camera), m_scheduler(scheduler), m_framesInFlight(std::max(framesInFlight, 1u)),
+	m_scenes(queueSize), m_images(m_framesInFlight), m_writer(m_framesInFlight + FRAME_WRITER_BUFFERS), m_cancelled(false),
+	m_animateTime(0), m_renderTime(0), m_encodeTime(0), m_wallTime(0), m_renderCpuTime(0)
+{
+}
+
+FramePipeline::~FramePipeline()
+{
+}
+
+void FramePipeline::Run(Sphere** spheres, unsigned int allocatedNum, int firstFrame, int endFrame,
+	const std::string& framePrefix, const FrameCallback& frameWritten)
+{
+	m_animateTime = m_renderTime = m_encodeTime = 0;
+	m_cancelled = false;
+	auto runStart = std::chrono::steady_clock::now();
+	double busyBefore = m_scheduler->GetBusyTime(), cpuBefore = m_scheduler->GetCpuTime();
+	std::thread renderer(&FramePipeline::RenderStage, this);
+	std::thread encoder(&FramePipeline::EncodeStage, this, framePrefix, frameWritten);
+
+	std::vector<Sphere> restPose;
+	for (unsigned int i = 0; i < allocatedNum; i++)
+		restPose.push_back(*spheres[i]);
+
+	std::shared_ptr<const SceneSnapshot> scene;
+	for (int frame = firstFrame; frame < endFrame && !m_cancelled; frame++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		AnimationSystem::GetInstance()->Evaluate(spheres, restPose.data(), allocatedNum, (float)frame);
+		// the later stages keep their own reference, the spheres above can change freely
+		scene = SceneSnapshot::Create(spheres, allocatedNum, scene);
+		m_animateTime += Milliseconds(std::chrono::steady_clock::now() - start).count();
+
+		m_scenes.Push({ frame, scene });
+	}
+	m_scenes.Close();
+
+	renderer.join();
+	encoder.join();
+	m_renderTime = m_scheduler->GetBusyTime() - busyBefore;
+	m_renderCpuTime = m_scheduler->GetCpuTime() - cpuBefore;
+	m_wallTime = Milliseconds(std::chrono::steady_clock::now() - runStart).count();
+
+	for (unsigned int i = 0; i < allocatedNum; i++)
+		*spheres[i] = restPose[i];
+}
+
+void FramePipeline::Cancel()
+{
+	std::lock_guard<std::mutex> lock(m_runningMutex);
+	m_cancelled = true;
+	for (const TaskScheduler::FrameHandle& task : m_running)
+		m_scheduler->Cancel(task);
+	m_runningChanged.notify_all();
+}
+
+void FramePipeline::RenderStage()
+{
+	const unsigned int width = m_camera->GetWidth(), height = m_camera->GetHeight();
+	SceneJob job;
+	// keeps draining the queue after a Cancel so the animate stage is never stuck on it
+	while (m_scenes.Pop(job))
+	{
+		// not constructed, each tile is first touched by the worker rendering it
+		Vec3f* image = (Vec3f*)::operator new(sizeof(Vec3f) * width * height);
+		std::shared_ptr<FrameStats> stats(new FrameStats());
+
+		std::unique_lock<std::mutex> lock(m_runningMutex);
+		m_runningChanged.wait(lock, [this]() { return m_running.size() < m_framesInFlight || m_cancelled; });
+		if (m_cancelled)
+		{
+			::operator delete(image);
+			continue;
+		}
+		TaskScheduler::FrameHandle task = m_scheduler->Submit(job.frame, job.scene, m_camera, image, stats.get(),
+			gRenderSettings.frameBudgetMs, &m_completed);
+		m_running.push_back(task);
+		lock.unlock();
+
+		// never waits, the queue holds framesInFlight frames
+		m_images.Push({ job.frame, image, nullptr, stats, task, 0 });
+	}
+	m_images.Close();
+}
+
+void FramePipeline::EncodeStage(const std::string& framePrefix, const FrameCallback& frameWritten)
+{
+	const unsigned int width = m_camera->GetWidth();
+	// frames taken from the render stage, oldest first, their tiles arrive in any order
+	std::deque<ImageJob> inFlight;
+	ImageJob job;
+	while (true)
+	{
+		if (m_cancelled)
+		{
+			DropFrames(inFlight);
+			// the frames the render stage submitted before the Cancel
+			if (!m_images.Pop(job))
+				break;
+			inFlight.push_back(job);
+			continue;
+		}
+
+		if (inFlight.empty())
+		{
+			if (!m_images.Pop(job))
+				break;
+			StartFrame(job, inFlight);
+			continue;
+		}
+
+		TaskScheduler::CompletedTile tile;
+		if (!m_completed.Pop(tile, std::chrono::milliseconds(10)))
+			continue;
+
+		size_t done = 0;
+		while (done < inFlight.size() && inFlight[done].task.get() != tile.frame)
+		{
+			// a frame is queued for this stage right after it is submitted, so the one
+			// the tile belongs to is on its way
+			if (++done == inFlight.size() && m_images.Pop(job))
+				StartFrame(job, inFlight);
+		}
+		if (done == inFlight.size() || m_cancelled)
+			continue;
+
+		auto start = std::chrono::steady_clock::now();
+		ImageJob& frame = inFlight[done];
+		QuantiseFrame(frame.image + tile.startRow * width, (tile.endRow - tile.startRow) * width,
+			frame.pixels + tile.startRow * width * 3);
+		if (++frame.tilesDone == frame.task->tileNum)
+		{
+			FinishFrame(frame, framePrefix, frameWritten);
+			inFlight.erase(inFlight.begin() + done);
+		}
+		m_encodeTime += Milliseconds(std::chrono::steady_clock::now() - start).count();
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	m_writer.Flush();
+	m_encodeTime += Milliseconds(std::chrono::steady_clock::now() - start).count();
+}
+
+void FramePipeline::StartFrame(ImageJob& job, std::deque<ImageJob>& inFlight)
+{
+	// waiting for a buffer runs frame callbacks, which may Cancel
+	job.pixels = m_writer.GetPixelBuffer(m_camera->GetWidth(), m_camera->GetHeight());
+	inFlight.push_back(job);
+}
+
+void FramePipeline::FinishFrame(ImageJob& job, const std::string& framePrefix, const FrameCallback& frameWritten)
+{
+	// the last worker pushed its tile just before it let go of the frame
+	m_scheduler->Wait(job.task);
+	{
+		std::lock_guard<std::mutex> lock(m_runningMutex);
+		for (auto running = m_running.begin(); running != m_running.end(); ++running)
+		{
+			if (*running == job.task)
+			{
+				m_running.erase(running);
+				break;
+			}
+		}
+		m_runningChanged.notify_all();
+	}
+	::operator delete(job.image);
+
+	int frame = job.frame;
+	std::shared_ptr<FrameStats> stats = job.stats;
+	m_writer.Submit(job.pixels, GetFramePath(framePrefix, frame),
+		[frame, stats, &frameWritten](bool succeeded)
+		{
+			if (frameWritten)
+				frameWritten(frame, *stats, succeeded);
+		});
+}
+
+void FramePipeline::DropFrames(std::deque<ImageJob>& inFlight)
+{
+	// every worker pushes at most the tile it is on once the rest are dropped, empty
+	// the queue first so none of them waits on it
+	TaskScheduler::CompletedTile tile;
+	while (m_completed.TryPop(tile))
+		;
+	for (ImageJob& dropped : inFlight)
+	{
+		m_scheduler->Wait(dropped.task);
+		if (dropped.pixels)
+			m_writer.Discard(dropped.pixels);
+		::operator delete(dropped.image);
+	}
+	inFlight.clear();
+	while (m_completed.TryPop(tile))
+		;
+
+	std::lock_guard<std::mutex> lock(m_runningMutex);
+	m_running.clear();
+	m_runningChanged.notify_all();
+}
@@ -0,0 +1,110 @@
+#ifndef FRAMEPIPELINE_H
+#define FRAMEPIPELINE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "BoundedQueue.h"
+#include "Camera.h"
+#include "FrameWriter.h"
+#include "Renderer.h"
+#include "SceneSnapshot.h"
+#include "Sphere.h"
+#include "TaskScheduler.h"
+
+//[comment]
+// Renders an animation in three stages running at the same time, connected by bounded
+// queues: the calling thread evaluates the animation and takes the scene snapshot of
+// frame N+2, a render thread submits frame N+1 to the TaskScheduler and an encode
+// thread quantises and writes frame N. The encode thread streams the finished tiles
+// back from the CompletedTileQueue and quantises each one into the frame's FrameWriter
+// buffer while the rest of the frame is still traced, so a frame is written as soon as
+// its last tile lands. Up to framesInFlight frames are rendered at once, the
+// scheduler's workers move on to the tiles of the next frame while the last tiles of
+// the current one finish. Every frame gets RenderSettings::frameBudgetMs, and Cancel
+// stops a Run at tile granularity.
+//[/comment]
+class FramePipeline
+{
+public:
+	// Called on the encode thread once a frame file is written, or could not be
+	// (written is false), frames finish writing in any order
+	typedef std::function<void(int frame, const FrameStats& stats, bool written)> FrameCallback;
+
+	FramePipeline(const Camera* camera, TaskScheduler* scheduler, unsigned int queueSize = 1,
+		unsigned int framesInFlight = 2);
+	~FramePipeline();
+
+	// Renders frames [firstFrame, endFrame) to <framePrefix><frame>.ppm, the
+	// spheres are left in the pose they had before
+	void Run(Sphere** spheres, unsigned int allocatedNum, int firstFrame, int endFrame,
+		const std::string& framePrefix, const FrameCallback& frameWritten = FrameCallback());
+
+	// Stops the current Run from any thread (a frame callback too): no more frames are
+	// animated, frames in flight drop the tiles not started yet and are not written
+	void Cancel();
+	bool WasCancelled() const { return m_cancelled; }
+
+	// Time each stage spent working during the last Run, in milliseconds. The render
+	// time is summed over the scheduler's workers
+	double GetAnimateTime() const { return m_animateTime; }
+	double GetRenderTime() const { return m_renderTime; }
+	double GetEncodeTime() const { return m_encodeTime; }
+	double GetWallTime() const { return m_wallTime; }
+	// CPU time of the render workers during the last Run
+	double GetRenderCpuTime() const { return m_renderCpuTime; }
+	// Bandwidth and queue depth of the frame writes
+	const FrameWriter& GetWriter() const { return m_writer; }
+
+private:
+	struct SceneJob
+	{
+		int frame;
+		std::shared_ptr<const SceneSnapshot> scene;
+	};
+
+	struct ImageJob
+	{
+		int frame;
+		Vec3f* image;
+		// the frame's buffer in m_writer, taken by the encode thread
+		unsigned char* pixels;
+		std::shared_ptr<FrameStats> stats;
+		TaskScheduler::FrameHandle task;
+		unsigned int tilesDone;
+	};
+
+	void RenderStage();
+	void EncodeStage(const std::string& framePrefix, const FrameCallback& frameWritten);
+	// Takes a frame from the render stage and a buffer to quantise it into
+	void StartFrame(ImageJob& job, std::deque<ImageJob>& inFlight);
+	// Waits for a frame whose tiles all arrived and writes it
+	void FinishFrame(ImageJob& job, const std::string& framePrefix, const FrameCallback& frameWritten);
+	// Frees the frames of a cancelled Run once their workers let go of them
+	void DropFrames(std::deque<ImageJob>& inFlight);
+
+	const Camera* m_camera;
+	TaskScheduler* m_scheduler;
+	unsigned int m_framesInFlight;
+	BoundedQueue<SceneJob> m_scenes;
+	BoundedQueue<ImageJob> m_images;
+	// tiles the workers finished, only popped by the encode thread
+	TaskScheduler::CompletedTileQueue m_completed;
+	// only used by the encode thread
+	FrameWriter m_writer;
+
+	std::atomic<bool> m_cancelled;
+	// frames handed to the scheduler and not finished, for Cancel. The render thread
+	// waits on m_runningChanged while framesInFlight of them are running
+	std::mutex m_runningMutex;
+	std::condition_variable m_runningChanged;
+	std::vector<TaskScheduler::FrameHandle> m_running;
+
+	double m_animateTime, m_renderTime, m_encodeTime, m_wallTime, m_renderCpuTime;
+};
+#endif
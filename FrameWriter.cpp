@@ -0,0 +1,422 @@
+#include "FrameWriter.h"
+
+#include <fstream>
+#include <sstream>
+#include <string.h>
+#include "Renderer.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#if defined __has_include
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define FRAME_WRITER_IO_URING 1
+#endif
+#endif
+#endif
+
+namespace
+{
+	typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+	// Stores size bytes as the whole file, false on any error
+	bool WriteWholeFile(const std::string& filename, const unsigned char* data, size_t size)
+	{
+#ifdef __linux__
+		int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0)
+			return false;
+		size_t written = 0;
+		while (written < size)
+		{
+			ssize_t result = pwrite(fd, data + written, size - written, (off_t)written);
+			if (result <= 0)
+				break;
+			written += (size_t)result;
+		}
+		return close(fd) == 0 && written == size;
+#else
+		// keep these flags if you compile under Windows
+		std::ofstream ofs(filename, std::ios::out | std::ios::binary);
+		ofs.write((const char*)data, (std::streamsize)size);
+		ofs.close();
+		return !ofs.fail();
+#endif
+	}
+}
+
+#ifdef FRAME_WRITER_IO_URING
+// Submission and completion rings shared with the kernel
+struct FrameWriter::Ring
+{
+	int fd;
+	void* sqMap;
+	size_t sqMapSize;
+	void* cqMap;
+	size_t cqMapSize;
+	io_uring_sqe* sqes;
+	size_t sqesSize;
+
+	unsigned* sqTail;
+	unsigned* sqMask;
+	unsigned* sqArray;
+	unsigned* cqHead;
+	unsigned* cqTail;
+	unsigned* cqMask;
+	io_uring_cqe* cqes;
+
+	// one iovec per buffer, read by the kernel when the write is submitted
+	std::vector<iovec> iovecs;
+};
+#else
+struct FrameWriter::Ring
+{
+};
+#endif
+
+FrameWriter::FrameWriter(unsigned int bufferNum) :
+	m_buffers(std::max(bufferNum, 1u)), m_inFlight(0), m_ring(nullptr), m_stopping(false),
+	m_bytesWritten(0), m_failedWrites(0), m_busyTime(0), m_depthSum(0), m_submits(0), m_maxDepth(0)
+{
+	for (Buffer& buffer : m_buffers)
+	{
+		buffer.headerSize = buffer.written = 0;
+		buffer.fd = -1;
+		buffer.failed = false;
+		buffer.state = BUFFER_FREE;
+	}
+
+	if (!gRenderSettings.ioUring || !SetupRing())
+		m_writeThread = std::thread(&FrameWriter::WriteThreadLoop, this);
+}
+
+FrameWriter::~FrameWriter()
+{
+	Flush();
+	if (m_writeThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+			m_queued.notify_all();
+		}
+		m_writeThread.join();
+	}
+	TeardownRing();
+}
+
+unsigned char* FrameWriter::GetPixelBuffer(unsigned int width, unsigned int height)
+{
+	Reap(false);
+	while (true)
+	{
+		for (unsigned int i = 0; i < m_buffers.size(); i++)
+		{
+			if (m_buffers[i].state != BUFFER_FREE)
+				continue;
+
+			std::stringstream header;
+			header << "P6\n" << width << " " << height << "\n255\n";
+			Buffer& buffer = m_buffers[i];
+			buffer.headerSize = header.str().size();
+			buffer.data.resize(buffer.headerSize + (size_t)width * height * 3);
+			memcpy(buffer.data.data(), header.str().data(), buffer.headerSize);
+			buffer.state = BUFFER_FILLING;
+			return buffer.data.data() + buffer.headerSize;
+		}
+		Reap(true);
+	}
+}
+
+void FrameWriter::Submit(const unsigned char* pixels, const std::string& filename, const WriteCallback& written)
+{
+	int filling = FindFilling(pixels);
+	if (filling < 0)
+		return;
+	unsigned int index = (unsigned int)filling;
+	Buffer& buffer = m_buffers[index];
+	buffer.filename = filename;
+	buffer.written = 0;
+	buffer.failed = false;
+	buffer.callback = written;
+	buffer.state = BUFFER_IN_FLIGHT;
+
+	if (m_inFlight++ == 0)
+		m_busyStart = std::chrono::steady_clock::now();
+	m_depthSum += m_inFlight;
+	m_submits++;
+	m_maxDepth = std::max(m_maxDepth, m_inFlight);
+
+	if (m_ring)
+	{
+#ifdef __linux__
+		buffer.fd = open(buffer.filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+		if (buffer.fd < 0)
+		{
+			buffer.failed = true;
+			Finish(index);
+		}
+		else
+			SubmitRingWrite(index);
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.push_back(index);
+		m_queued.notify_one();
+	}
+	Reap(false);
+}
+
+void FrameWriter::Discard(const unsigned char* pixels)
+{
+	int filling = FindFilling(pixels);
+	if (filling >= 0)
+		m_buffers[filling].state = BUFFER_FREE;
+}
+
+int FrameWriter::FindFilling(const unsigned char* pixels) const
+{
+	for (unsigned int i = 0; i < m_buffers.size(); i++)
+	{
+		const Buffer& buffer = m_buffers[i];
+		if (buffer.state == BUFFER_FILLING && buffer.data.data() + buffer.headerSize == pixels)
+			return (int)i;
+	}
+	return -1;
+}
+
+void FrameWriter::Flush()
+{
+	while (m_inFlight > 0)
+		Reap(true);
+}
+
+double FrameWriter::GetBandwidth() const
+{
+	return m_busyTime > 0 ? m_bytesWritten / (m_busyTime * 1000.0) : 0;
+}
+
+double FrameWriter::GetAverageQueueDepth() const
+{
+	return m_submits > 0 ? (double)m_depthSum / m_submits : 0;
+}
+
+void FrameWriter::WriteThreadLoop()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		m_queued.wait(lock, [this]() { return !m_queue.empty() || m_stopping; });
+		if (m_queue.empty())
+			return;
+		unsigned int index = m_queue.front();
+		m_queue.pop_front();
+		Buffer& buffer = m_buffers[index];
+		lock.unlock();
+
+		buffer.failed = !WriteWholeFile(buffer.filename, buffer.data.data(), buffer.data.size());
+		buffer.written = buffer.failed ? 0 : buffer.data.size();
+
+		lock.lock();
+		m_done.push_back(index);
+		m_written.notify_one();
+	}
+}
+
+void FrameWriter::Reap(bool wait)
+{
+	if (m_ring)
+	{
+		ReapRing(wait);
+		return;
+	}
+
+	std::deque<unsigned int> done;
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (wait && m_inFlight > 0)
+			m_written.wait(lock, [this]() { return !m_done.empty(); });
+		done.swap(m_done);
+	}
+	for (unsigned int index : done)
+		Finish(index);
+}
+
+void FrameWriter::Finish(unsigned int index)
+{
+	Buffer& buffer = m_buffers[index];
+#ifdef __linux__
+	if (buffer.fd >= 0 && close(buffer.fd) != 0)
+		buffer.failed = true;
+#endif
+	buffer.fd = -1;
+
+	if (buffer.failed)
+		m_failedWrites++;
+	else
+		m_bytesWritten += buffer.written;
+	if (--m_inFlight == 0)
+		m_busyTime += Milliseconds(std::chrono::steady_clock::now() - m_busyStart).count();
+
+	buffer.state = BUFFER_FREE;
+	if (buffer.callback)
+	{
+		WriteCallback callback;
+		callback.swap(buffer.callback);
+		callback(!buffer.failed);
+	}
+}
+
+#ifdef FRAME_WRITER_IO_URING
+bool FrameWriter::SetupRing()
+{
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	int fd = (int)syscall(__NR_io_uring_setup, (unsigned)m_buffers.size(), &params);
+	if (fd < 0)
+		return false;
+
+	Ring* ring = new Ring();
+	ring->fd = fd;
+	ring->sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	// newer kernels map both rings at once
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		ring->sqMapSize = ring->cqMapSize = std::max(ring->sqMapSize, ring->cqMapSize);
+	ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+	ring->sqMap = mmap(0, ring->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	ring->cqMap = (params.features & IORING_FEAT_SINGLE_MMAP) ? ring->sqMap :
+		mmap(0, ring->cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+	void* sqes = mmap(0, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (ring->sqMap == MAP_FAILED || ring->cqMap == MAP_FAILED || sqes == MAP_FAILED)
+	{
+		if (ring->sqMap != MAP_FAILED)
+			munmap(ring->sqMap, ring->sqMapSize);
+		if (ring->cqMap != MAP_FAILED && ring->cqMap != ring->sqMap)
+			munmap(ring->cqMap, ring->cqMapSize);
+		if (sqes != MAP_FAILED)
+			munmap(sqes, ring->sqesSize);
+		close(fd);
+		delete ring;
+		return false;
+	}
+
+	unsigned char* sq = (unsigned char*)ring->sqMap;
+	unsigned char* cq = (unsigned char*)ring->cqMap;
+	ring->sqes = (io_uring_sqe*)sqes;
+	ring->sqTail = (unsigned*)(sq + params.sq_off.tail);
+	ring->sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+	ring->sqArray = (unsigned*)(sq + params.sq_off.array);
+	ring->cqHead = (unsigned*)(cq + params.cq_off.head);
+	ring->cqTail = (unsigned*)(cq + params.cq_off.tail);
+	ring->cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+	ring->cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+	ring->iovecs.resize(m_buffers.size());
+	m_ring = ring;
+	return true;
+}
+
+void FrameWriter::TeardownRing()
+{
+	if (!m_ring)
+		return;
+	munmap(m_ring->sqes, m_ring->sqesSize);
+	if (m_ring->cqMap != m_ring->sqMap)
+		munmap(m_ring->cqMap, m_ring->cqMapSize);
+	munmap(m_ring->sqMap, m_ring->sqMapSize);
+	close(m_ring->fd);
+	delete m_ring;
+	m_ring = nullptr;
+}
+
+void FrameWriter::SubmitRingWrite(unsigned int index)
+{
+	Buffer& buffer = m_buffers[index];
+	size_t size = buffer.data.size();
+	iovec& iov = m_ring->iovecs[index];
+	iov.iov_base = buffer.data.data() + buffer.written;
+	iov.iov_len = size - buffer.written;
+
+	// at most one write per buffer is queued, so the ring (one entry per buffer) has room
+	unsigned tail = *m_ring->sqTail;
+	unsigned slot = tail & *m_ring->sqMask;
+	io_uring_sqe* sqe = &m_ring->sqes[slot];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_WRITEV;
+	sqe->fd = buffer.fd;
+	sqe->addr = (unsigned long long)&iov;
+	sqe->len = 1;
+	sqe->off = buffer.written;
+	sqe->user_data = index;
+	m_ring->sqArray[slot] = slot;
+	__atomic_store_n(m_ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+
+	if (syscall(__NR_io_uring_enter, m_ring->fd, 1, 0, 0, nullptr, 0) != 1)
+	{
+		// not consumed by the kernel, take the entry back
+		__atomic_store_n(m_ring->sqTail, tail, __ATOMIC_RELEASE);
+		buffer.failed = true;
+		Finish(index);
+	}
+}
+
+void FrameWriter::ReapRing(bool wait)
+{
+	unsigned head = *m_ring->cqHead;
+	if (wait && m_inFlight > 0 && head == __atomic_load_n(m_ring->cqTail, __ATOMIC_ACQUIRE))
+		syscall(__NR_io_uring_enter, m_ring->fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+
+	std::vector<unsigned int> finished, partial;
+	while (head != __atomic_load_n(m_ring->cqTail, __ATOMIC_ACQUIRE))
+	{
+		const io_uring_cqe& cqe = m_ring->cqes[head & *m_ring->cqMask];
+		unsigned int index = (unsigned int)cqe.user_data;
+		Buffer& buffer = m_buffers[index];
+		if (cqe.res <= 0)
+		{
+			buffer.failed = true;
+			finished.push_back(index);
+		}
+		else
+		{
+			buffer.written += (size_t)cqe.res;
+			if (buffer.written < buffer.data.size())
+				partial.push_back(index);
+			else
+				finished.push_back(index);
+		}
+		head++;
+	}
+	__atomic_store_n(m_ring->cqHead, head, __ATOMIC_RELEASE);
+
+	// short writes continue where they stopped
+	for (unsigned int index : partial)
+		SubmitRingWrite(index);
+	for (unsigned int index : finished)
+		Finish(index);
+}
+#else
+bool FrameWriter::SetupRing()
+{
+	return false;
+}
+
+void FrameWriter::TeardownRing()
+{
+}
+
+void FrameWriter::SubmitRingWrite(unsigned int)
+{
+}
+
+void FrameWriter::ReapRing(bool)
+{
+}
+#endif
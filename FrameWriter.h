@@ -0,0 +1,110 @@
+#ifndef FRAMEWRITER_H
+#define FRAMEWRITER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Frame files a FrameWriter keeps in flight by default
+#define FRAME_WRITER_BUFFERS 4
+
+//[comment]
+// Writes PPM frames asynchronously from a fixed set of buffers. The caller quantises
+// a frame into GetPixelBuffer and submits it, and only waits when every buffer is
+// still being filled or written. Several frames can be filled at once, in any
+// order. On Linux the writes go through io_uring (raw syscalls, no liburing); when
+// the kernel or the settings do not allow that, a write thread stores the buffers
+// with pwrite instead. Completion callbacks always run on the
+// calling thread, from GetPixelBuffer, Submit or Flush.
+// Not thread safe, one thread owns the writer.
+//[/comment]
+class FrameWriter
+{
+public:
+	typedef std::function<void(bool succeeded)> WriteCallback;
+
+	explicit FrameWriter(unsigned int bufferNum = FRAME_WRITER_BUFFERS);
+	~FrameWriter();
+
+	// Room for the 3 bytes per pixel of a frame, waits for a write when every buffer
+	// is busy, so fewer frames than buffers may be filled at once
+	unsigned char* GetPixelBuffer(unsigned int width, unsigned int height);
+	// Starts writing a buffer from GetPixelBuffer to filename
+	void Submit(const unsigned char* pixels, const std::string& filename,
+		const WriteCallback& written = WriteCallback());
+	// Gives a buffer from GetPixelBuffer back without writing it
+	void Discard(const unsigned char* pixels);
+	// Waits for every submitted frame
+	void Flush();
+
+	bool UsesIoUring() const { return m_ring != nullptr; }
+	const char* GetBackendName() const { return UsesIoUring() ? "io_uring" : "write thread"; }
+
+	unsigned long long GetBytesWritten() const { return m_bytesWritten; }
+	unsigned int GetFailedWrites() const { return m_failedWrites; }
+	// MB/s over the time at least one write was in flight
+	double GetBandwidth() const;
+	// Frames in flight right after each Submit
+	double GetAverageQueueDepth() const;
+	unsigned int GetMaxQueueDepth() const { return m_maxDepth; }
+
+private:
+	enum BufferState
+	{
+		BUFFER_FREE = 0,
+		BUFFER_FILLING,
+		BUFFER_IN_FLIGHT
+	};
+
+	struct Buffer
+	{
+		std::vector<unsigned char> data;
+		std::string filename;
+		size_t headerSize;
+		size_t written;
+		int fd;
+		bool failed;
+		BufferState state;
+		WriteCallback callback;
+	};
+
+	struct Ring;
+
+	bool SetupRing();
+	void TeardownRing();
+	void SubmitRingWrite(unsigned int buffer);
+
+	void WriteThreadLoop();
+
+	// Collects finished writes, waiting for one if wait is set and any are in flight
+	void Reap(bool wait);
+	void ReapRing(bool wait);
+	void Finish(unsigned int buffer);
+	// Buffer being filled whose pixels start at pixels, -1 if there is none
+	int FindFilling(const unsigned char* pixels) const;
+
+	std::vector<Buffer> m_buffers;
+	unsigned int m_inFlight;
+
+	Ring* m_ring;
+
+	// write thread fallback, the buffers it was given and the ones it has written
+	std::thread m_writeThread;
+	std::mutex m_mutex;
+	std::condition_variable m_queued, m_written;
+	std::deque<unsigned int> m_queue, m_done;
+	bool m_stopping;
+
+	unsigned long long m_bytesWritten;
+	unsigned int m_failedWrites;
+	double m_busyTime;
+	std::chrono::steady_clock::time_point m_busyStart;
+	unsigned long long m_depthSum;
+	unsigned int m_submits, m_maxDepth;
+};
+#endif
@@ -0,0 +1,22 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include "Commons.h"
+
+// Surface properties of a sphere, kept apart from its geometry so the
+// intersection loops never have to read them
+struct Material
+{
+	Vec3f surfaceColor, emissionColor;
+	float transparency, reflection;
+
+	bool operator == (const Material& m) const
+	{
+		return surfaceColor.x == m.surfaceColor.x && surfaceColor.y == m.surfaceColor.y &&
+			surfaceColor.z == m.surfaceColor.z &&
+			emissionColor.x == m.emissionColor.x && emissionColor.y == m.emissionColor.y &&
+			emissionColor.z == m.emissionColor.z &&
+			transparency == m.transparency && reflection == m.reflection;
+	}
+};
+#endif
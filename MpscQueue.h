@@ -0,0 +1,118 @@
+#ifndef MPSCQUEUE_H
+#define MPSCQUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+//[comment]
+// Lock-free queue many threads push to and one thread pops from, a fixed ring of
+// Capacity (a power of two) slots, so pushing never allocates. Every slot carries a
+// sequence number telling whose turn it is: producers claim a position with a
+// compare and swap on the tail and publish the item by advancing the slot's
+// sequence, the consumer only reads its own head. The mutex and condition variable
+// are only touched when the consumer found the queue empty and went to sleep.
+//[/comment]
+template<typename T, size_t Capacity>
+class MpscQueue
+{
+	static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+	MpscQueue() : m_tail(0), m_head(0), m_sleeping(false)
+	{
+		for (size_t i = 0; i < Capacity; i++)
+			m_slots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	// False if the ring is full
+	bool TryPush(const T& item)
+	{
+		size_t position = m_tail.load(std::memory_order_relaxed);
+		Slot* slot;
+		while (true)
+		{
+			slot = &m_slots[position & (Capacity - 1)];
+			size_t sequence = slot->sequence.load(std::memory_order_acquire);
+			long long difference = (long long)sequence - (long long)position;
+			if (difference == 0)
+			{
+				if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (difference < 0)
+				return false;
+			else
+				position = m_tail.load(std::memory_order_relaxed);
+		}
+		slot->item = item;
+		slot->sequence.store(position + 1, std::memory_order_release);
+
+		// pairs with the fence in Pop, either the consumer sees the item or we see it asleep
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_sleeping.load(std::memory_order_relaxed))
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_wake.notify_one();
+		}
+		return true;
+	}
+
+	// Waits while the ring is full, the consumer is expected to keep up
+	void Push(const T& item)
+	{
+		while (!TryPush(item))
+			std::this_thread::yield();
+	}
+
+	// Consumer only, false if the queue is empty
+	bool TryPop(T& item)
+	{
+		Slot& slot = m_slots[m_head & (Capacity - 1)];
+		if (slot.sequence.load(std::memory_order_acquire) != m_head + 1)
+			return false;
+		item = slot.item;
+		slot.sequence.store(m_head + Capacity, std::memory_order_release);
+		m_head++;
+		return true;
+	}
+
+	// Consumer only, sleeps up to timeout for an item
+	template<typename Rep, typename Period>
+	bool Pop(T& item, const std::chrono::duration<Rep, Period>& timeout)
+	{
+		if (TryPop(item))
+			return true;
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_sleeping.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		bool popped = TryPop(item);
+		if (!popped)
+		{
+			m_wake.wait_for(lock, timeout);
+			popped = TryPop(item);
+		}
+		m_sleeping.store(false, std::memory_order_relaxed);
+		return popped;
+	}
+
+private:
+	struct Slot
+	{
+		std::atomic<size_t> sequence;
+		T item;
+	};
+
+	Slot m_slots[Capacity];
+	// producers and the consumer on their own cache lines
+	alignas(64) std::atomic<size_t> m_tail;
+	alignas(64) size_t m_head;
+
+	std::atomic<bool> m_sleeping;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+};
+#endif
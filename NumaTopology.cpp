@@ -0,0 +1,105 @@
+#include "NumaTopology.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace
+{
+	// Parses a sysfs cpu list such as "0-3,8-11"
+	std::vector<int> ParseCpuList(const std::string& list)
+	{
+		std::vector<int> cpus;
+		std::stringstream ss(list);
+		std::string range;
+		while (std::getline(ss, range, ','))
+		{
+			if (range.empty() || range == "\n")
+				continue;
+			size_t dash = range.find('-');
+			int first = std::stoi(range.substr(0, dash));
+			int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+			for (int cpu = first; cpu <= last; cpu++)
+				cpus.push_back(cpu);
+		}
+		return cpus;
+	}
+}
+
+NumaTopology* NumaTopology::m_instance = 0;
+
+NumaTopology::NumaTopology()
+{
+#ifdef __linux__
+	// node numbers can have gaps, stop after a few missing ones
+	for (int node = 0, missing = 0; missing < 8; node++)
+	{
+		std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+		std::string list;
+		if (!file || !std::getline(file, list))
+		{
+			missing++;
+			continue;
+		}
+		missing = 0;
+
+		std::vector<int> cpus = ParseCpuList(list);
+		if (!cpus.empty())
+			m_nodeCpus.push_back(cpus);
+	}
+#endif
+
+	if (m_nodeCpus.empty())
+	{
+		unsigned int cpuNum = std::max(std::thread::hardware_concurrency(), 1u);
+		m_nodeCpus.push_back(std::vector<int>());
+		for (unsigned int cpu = 0; cpu < cpuNum; cpu++)
+			m_nodeCpus[0].push_back(cpu);
+	}
+}
+
+NumaTopology::~NumaTopology()
+{
+}
+
+unsigned int NumaTopology::GetCpuNum() const
+{
+	unsigned int cpuNum = 0;
+	for (const std::vector<int>& cpus : m_nodeCpus)
+		cpuNum += (unsigned int)cpus.size();
+	return cpuNum;
+}
+
+unsigned int NumaTopology::GetWorkerNode(unsigned int worker, unsigned int workerNum) const
+{
+	return (unsigned int)((unsigned long long)worker * GetNodeNum() / std::max(workerNum, 1u));
+}
+
+bool NumaTopology::PinThreadToNode(unsigned int node) const
+{
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int cpu : m_nodeCpus[node % GetNodeNum()])
+	{
+		if (cpu < CPU_SETSIZE)
+			CPU_SET(cpu, &set);
+	}
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
+}
+
+NumaTopology* NumaTopology::GetInstance()
+{
+	if (m_instance == 0)
+		m_instance = new NumaTopology();
+	return m_instance;
+}
@@ -0,0 +1,32 @@
+#ifndef NUMATOPOLOGY_H
+#define NUMATOPOLOGY_H
+
+#include <vector>
+
+// CPUs of every NUMA node, read from /sys/devices/system/node on Linux. Elsewhere,
+// or without that directory, the machine is one node holding every CPU.
+class NumaTopology
+{
+public:
+	unsigned int GetNodeNum() const { return (unsigned int)m_nodeCpus.size(); }
+	const std::vector<int>& GetCpus(unsigned int node) const { return m_nodeCpus[node]; }
+	unsigned int GetCpuNum() const;
+
+	// Node of worker out of workerNum, consecutive workers share a node so
+	// neighbouring parts of the image stay on the same socket
+	unsigned int GetWorkerNode(unsigned int worker, unsigned int workerNum) const;
+
+	// Restricts the calling thread to the CPUs of the node, false if not supported
+	bool PinThreadToNode(unsigned int node) const;
+
+	static NumaTopology* GetInstance();
+
+private:
+	NumaTopology();
+	~NumaTopology();
+
+	static NumaTopology* m_instance;
+
+	std::vector<std::vector<int>> m_nodeCpus;
+};
+#endif
@@ -0,0 +1,103 @@
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+
+namespace
+{
+	int OpenCounter(unsigned int type, unsigned long long config)
+	{
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	}
+}
+
+PerfCounters::PerfCounters()
+{
+	m_fd[CACHE_REFERENCES] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES);
+	m_fd[CACHE_MISSES] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+	m_fd[L1D_READ_MISSES] = OpenCounter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+		(PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+	for (int i = 0; i < COUNTER_NUM; i++)
+		m_values[i] = 0;
+}
+
+PerfCounters::~PerfCounters()
+{
+	for (int i = 0; i < COUNTER_NUM; i++)
+	{
+		if (m_fd[i] >= 0)
+			close(m_fd[i]);
+	}
+}
+
+void PerfCounters::Start()
+{
+	for (int i = 0; i < COUNTER_NUM; i++)
+	{
+		if (m_fd[i] < 0)
+			continue;
+		ioctl(m_fd[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(m_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+void PerfCounters::Stop()
+{
+	for (int i = 0; i < COUNTER_NUM; i++)
+	{
+		if (m_fd[i] < 0)
+			continue;
+		ioctl(m_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+		if (read(m_fd[i], &m_values[i], sizeof(m_values[i])) != sizeof(m_values[i]))
+			m_values[i] = 0;
+	}
+}
+#else
+PerfCounters::PerfCounters()
+{
+	for (int i = 0; i < COUNTER_NUM; i++)
+	{
+		m_fd[i] = -1;
+		m_values[i] = 0;
+	}
+}
+
+PerfCounters::~PerfCounters()
+{
+}
+
+void PerfCounters::Start()
+{
+}
+
+void PerfCounters::Stop()
+{
+}
+#endif
+
+const char* PerfCounters::GetName(Counter counter)
+{
+	switch (counter)
+	{
+	case CACHE_REFERENCES:
+		return "cache references";
+	case CACHE_MISSES:
+		return "cache misses";
+	case L1D_READ_MISSES:
+		return "L1D read misses";
+	default:
+		return "";
+	}
+}
@@ -0,0 +1,33 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+// Hardware cache counters of the calling thread, read through perf_event_open on
+// Linux. Counters the platform or the kernel do not provide read as unavailable.
+class PerfCounters
+{
+public:
+	enum Counter
+	{
+		CACHE_REFERENCES = 0,
+		CACHE_MISSES,
+		L1D_READ_MISSES,
+		COUNTER_NUM
+	};
+
+	PerfCounters();
+	~PerfCounters();
+
+	void Start();
+	void Stop();
+
+	bool IsAvailable(Counter counter) const { return m_fd[counter] >= 0; }
+	// Events counted between the last Start and Stop
+	unsigned long long Get(Counter counter) const { return m_values[counter]; }
+
+	static const char* GetName(Counter counter);
+
+private:
+	int m_fd[COUNTER_NUM];
+	unsigned long long m_values[COUNTER_NUM];
+};
+#endif
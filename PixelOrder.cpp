@@ -0,0 +1,125 @@
+#include "PixelOrder.h"
+
+#include <utility>
+
+namespace
+{
+	// Even bits of the Morton code
+	unsigned int CompactBits(unsigned int v)
+	{
+		v &= 0x55555555;
+		v = (v | (v >> 1)) & 0x33333333;
+		v = (v | (v >> 2)) & 0x0f0f0f0f;
+		v = (v | (v >> 4)) & 0x00ff00ff;
+		v = (v | (v >> 8)) & 0x0000ffff;
+		return v;
+	}
+
+	// Cell d of the Hilbert curve filling an n x n grid, n a power of two
+	void HilbertCell(unsigned int n, unsigned int d, unsigned int& x, unsigned int& y)
+	{
+		x = y = 0;
+		for (unsigned int s = 1; s < n; s *= 2)
+		{
+			unsigned int rx = 1 & (d / 2);
+			unsigned int ry = 1 & (d ^ rx);
+			if (ry == 0)
+			{
+				if (rx == 1)
+				{
+					x = s - 1 - x;
+					y = s - 1 - y;
+				}
+				std::swap(x, y);
+			}
+			x += s * rx;
+			y += s * ry;
+			d /= 4;
+		}
+	}
+}
+
+const char* GetPixelOrderName(PixelOrder order)
+{
+	switch (order)
+	{
+	case PixelOrder::Scanline:
+		return "Scanline";
+	case PixelOrder::Morton:
+		return "Morton";
+	case PixelOrder::Hilbert:
+		return "Hilbert";
+	default:
+		return "Unknown";
+	}
+}
+
+PixelTraversal::PixelTraversal() : m_order(PixelOrder::Max), m_width(0), m_rows(0), m_rowOffset(0)
+{
+}
+
+PixelTraversal::~PixelTraversal()
+{
+}
+
+void PixelTraversal::Build(PixelOrder order, unsigned int width, unsigned int rows, unsigned int firstRow)
+{
+	const unsigned int tileSize = PIXEL_ORDER_TILE_SIZE;
+	// rows of the band above its first whole tile, the scanline order has no tiles
+	const unsigned int rowOffset = order == PixelOrder::Scanline ? 0 : firstRow % tileSize;
+	if (order == m_order && width == m_width && rows == m_rows && rowOffset == m_rowOffset)
+		return;
+	m_order = order;
+	m_width = width;
+	m_rows = rows;
+	m_rowOffset = rowOffset;
+	m_pixels.clear();
+
+	if (order == PixelOrder::Scanline)
+	{
+		for (unsigned int y = 0; y < rows; y++)
+		{
+			for (unsigned int x = 0; x < width; x++)
+				m_pixels.push_back(x | (y << 16));
+		}
+		return;
+	}
+
+	// the grid starts rowOffset rows above the band
+	BuildCurve(order, (width + tileSize - 1) / tileSize, (rows + rowOffset + tileSize - 1) / tileSize, m_tiles);
+	BuildCurve(order, tileSize, tileSize, m_tilePixels);
+	for (unsigned int tile : m_tiles)
+	{
+		unsigned int tileX = (tile & 0xffff) * tileSize, tileY = (tile >> 16) * tileSize;
+		for (unsigned int cell : m_tilePixels)
+		{
+			unsigned int x = tileX + (cell & 0xffff), y = tileY + (cell >> 16);
+			// edge tiles are cut off by the image and the band
+			if (x < width && y >= rowOffset && y < rows + rowOffset)
+				m_pixels.push_back(x | ((y - rowOffset) << 16));
+		}
+	}
+}
+
+void PixelTraversal::BuildCurve(PixelOrder order, unsigned int width, unsigned int height,
+	std::vector<unsigned int>& cells)
+{
+	unsigned int n = 1;
+	while (n < width || n < height)
+		n *= 2;
+
+	cells.clear();
+	for (unsigned int d = 0; d < n * n; d++)
+	{
+		unsigned int x, y;
+		if (order == PixelOrder::Hilbert)
+			HilbertCell(n, d, x, y);
+		else
+		{
+			x = CompactBits(d);
+			y = CompactBits(d >> 1);
+		}
+		if (x < width && y < height)
+			cells.push_back(x | (y << 16));
+	}
+}
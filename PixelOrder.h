@@ -0,0 +1,56 @@
+#ifndef PIXELORDER_H
+#define PIXELORDER_H
+
+#include <vector>
+#include "TileCuller.h"
+
+// Edge of the tiles the curve orders visit one after the other, a culling tile so
+// every tile reads a single TileCuller list
+#define PIXEL_ORDER_TILE_SIZE CULL_TILE_SIZE
+
+enum class PixelOrder
+{
+	// row by row across the whole band
+	Scanline = 0,
+	// tiles in Z order, the pixels of each tile in Z order
+	Morton,
+	// tiles along a Hilbert curve, the pixels of each tile along one too
+	Hilbert,
+	Max
+};
+
+const char* GetPixelOrderName(PixelOrder order);
+
+//[comment]
+// The order in which RenderPixels visits the pixels of a band of rows. The curve
+// orders keep consecutive camera rays close together in both directions, so they
+// hit the same spheres and read the same culling list and camera direction entries
+// while those are still cached. Grids that are not a power of two are walked on the
+// enclosing power of two curve, skipping the cells outside.
+//[/comment]
+class PixelTraversal
+{
+public:
+	PixelTraversal();
+	~PixelTraversal();
+
+	// Does nothing if the order was already built for the same band. The curve tiles
+	// line up with image rows that are multiples of PIXEL_ORDER_TILE_SIZE, so for a
+	// band starting at firstRow the first and last tiles can be cut short
+	void Build(PixelOrder order, unsigned int width, unsigned int rows, unsigned int firstRow = 0);
+
+	// Every pixel of the band once, as x | (row in the band << 16)
+	const unsigned int* GetPixels() const { return m_pixels.data(); }
+	unsigned int GetPixelNum() const { return (unsigned int)m_pixels.size(); }
+
+private:
+	// Cells of a width x height grid in the order of the curve
+	static void BuildCurve(PixelOrder order, unsigned int width, unsigned int height,
+		std::vector<unsigned int>& cells);
+
+	PixelOrder m_order;
+	unsigned int m_width, m_rows, m_rowOffset;
+	std::vector<unsigned int> m_pixels;
+	std::vector<unsigned int> m_tiles, m_tilePixels;
+};
+#endif
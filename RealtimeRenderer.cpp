@@ -0,0 +1,173 @@
+#include "RealtimeRenderer.h"
+
+#include <chrono>
+#include "AnimationSystem.h"
+#include "FrameOutput.h"
+#include "FrameWriter.h"
+#include "Renderer.h"
+
+namespace
+{
+	typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+	// Cheapest first, the last level is the full quality frame with 2x2 samples
+	const QualityLevel QUALITY_LEVELS[] =
+	{
+		{ 0.25f, 1, 1 },
+		{ 0.25f, 2, 1 },
+		{ 0.375f, 2, 1 },
+		{ 0.5f, 2, 1 },
+		{ 0.5f, 3, 1 },
+		{ 0.75f, 3, 1 },
+		{ 0.75f, MAX_RAY_DEPTH, 1 },
+		{ 1.0f, MAX_RAY_DEPTH, 1 },
+		{ 1.0f, MAX_RAY_DEPTH, 2 },
+	};
+	const unsigned int QUALITY_LEVEL_NUM = sizeof(QUALITY_LEVELS) / sizeof(QUALITY_LEVELS[0]);
+
+	// A level is only raised if its estimated time stays below this share of the target
+	const double RAISE_HEADROOM = 0.85;
+
+	// Bilinear resampling between pixel centres, an exact box filter when shrinking by 2
+	void ResampleFrame(const Vec3f* source, unsigned int sourceWidth, unsigned int sourceHeight,
+		Vec3f* target, unsigned int targetWidth, unsigned int targetHeight)
+	{
+		// source columns and weight of every target column, the same for all rows
+		struct Tap
+		{
+			unsigned int first, second;
+			float weight;
+		};
+		auto getTap = [](unsigned int i, float scale, unsigned int sourceSize)
+		{
+			float s = std::max((i + 0.5f) * scale - 0.5f, 0.0f);
+			Tap tap;
+			tap.first = std::min((unsigned int)s, sourceSize - 1);
+			tap.second = std::min(tap.first + 1, sourceSize - 1);
+			tap.weight = std::min(s - tap.first, 1.0f);
+			return tap;
+		};
+
+		const float scaleX = sourceWidth / float(targetWidth), scaleY = sourceHeight / float(targetHeight);
+		std::vector<Tap> columns(targetWidth);
+		for (unsigned int x = 0; x < targetWidth; ++x)
+			columns[x] = getTap(x, scaleX, sourceWidth);
+
+		for (unsigned int y = 0; y < targetHeight; ++y)
+		{
+			Tap row = getTap(y, scaleY, sourceHeight);
+			const Vec3f* row0 = source + row.first * sourceWidth;
+			const Vec3f* row1 = source + row.second * sourceWidth;
+			for (const Tap& column : columns)
+			{
+				Vec3f top = row0[column.first] * (1 - column.weight) + row0[column.second] * column.weight;
+				Vec3f bottom = row1[column.first] * (1 - column.weight) + row1[column.second] * column.weight;
+				*target++ = top * (1 - row.weight) + bottom * row.weight;
+			}
+		}
+	}
+}
+
+RealtimeRenderer::RealtimeRenderer(TaskScheduler* scheduler, unsigned int outputWidth, unsigned int outputHeight,
+	double targetMs) :
+	m_scheduler(scheduler), m_outputWidth(outputWidth), m_outputHeight(outputHeight), m_targetMs(targetMs),
+	m_frames(0), m_framesOnTime(0), m_totalTime(0)
+{
+	for (unsigned int i = 0; i < QUALITY_LEVEL_NUM; i++)
+	{
+		const QualityLevel& level = QUALITY_LEVELS[i];
+		unsigned int width = std::max((unsigned int)(outputWidth * level.scale) * level.samplesPerAxis, 1u);
+		unsigned int height = std::max((unsigned int)(outputHeight * level.scale) * level.samplesPerAxis, 1u);
+		m_cameras.push_back(new Camera(width, height));
+	}
+	// start in the middle, the first frames find the level the machine can hold
+	m_level = QUALITY_LEVEL_NUM / 2;
+}
+
+RealtimeRenderer::~RealtimeRenderer()
+{
+	for (const Camera* camera : m_cameras)
+		delete camera;
+}
+
+const QualityLevel& RealtimeRenderer::GetLevel(unsigned int level) const
+{
+	return QUALITY_LEVELS[level];
+}
+
+double RealtimeRenderer::GetCost(unsigned int level) const
+{
+	int depth = std::min(QUALITY_LEVELS[level].maxDepth, gRenderSettings.maxDepth);
+	return (double)m_cameras[level]->GetWidth() * m_cameras[level]->GetHeight() * (1 + depth);
+}
+
+unsigned int RealtimeRenderer::ChooseLevel(unsigned int level, double frameMs) const
+{
+	// time the frame would have taken at another level
+	auto estimate = [&](unsigned int other) { return frameMs * GetCost(other) / GetCost(level); };
+
+	if (frameMs > m_targetMs)
+	{
+		unsigned int lower = level;
+		while (lower > 0 && estimate(lower) > m_targetMs)
+			lower--;
+		return lower;
+	}
+	if (level + 1 < GetLevelNum() && estimate(level + 1) < m_targetMs * RAISE_HEADROOM)
+		return level + 1;
+	return level;
+}
+
+void RealtimeRenderer::Run(Sphere** spheres, unsigned int allocatedNum, int firstFrame, int endFrame,
+	const std::string& framePrefix)
+{
+	const RenderSettings savedSettings = gRenderSettings;
+	m_frames = m_framesOnTime = 0;
+	m_totalTime = 0;
+
+	const Camera* largest = m_cameras.back();
+	std::vector<Vec3f> internal((size_t)largest->GetWidth() * largest->GetHeight());
+	std::vector<Vec3f> output((size_t)m_outputWidth * m_outputHeight);
+	FrameWriter writer;
+
+	std::vector<Sphere> restPose;
+	for (unsigned int i = 0; i < allocatedNum; i++)
+		restPose.push_back(*spheres[i]);
+
+	std::shared_ptr<const SceneSnapshot> scene;
+	for (int frame = firstFrame; frame < endFrame; frame++)
+	{
+		AnimationSystem::GetInstance()->Evaluate(spheres, restPose.data(), allocatedNum, (float)frame);
+		scene = SceneSnapshot::Create(spheres, allocatedNum, scene);
+
+		// the scheduler is idle between frames, so the settings can change here
+		const QualityLevel& level = QUALITY_LEVELS[m_level];
+		const Camera* camera = m_cameras[m_level];
+		gRenderSettings.maxDepth = std::min(level.maxDepth, savedSettings.maxDepth);
+
+		auto start = std::chrono::steady_clock::now();
+		m_scheduler->Render(scene, camera, internal.data());
+		ResampleFrame(internal.data(), camera->GetWidth(), camera->GetHeight(),
+			output.data(), m_outputWidth, m_outputHeight);
+		double frameMs = Milliseconds(std::chrono::steady_clock::now() - start).count();
+
+		m_frames++;
+		m_totalTime += frameMs;
+		if (frameMs <= m_targetMs)
+			m_framesOnTime++;
+		std::cout << "Frame " << frame << ": level " << m_level << " (" << camera->GetWidth() / level.samplesPerAxis <<
+			"x" << camera->GetHeight() / level.samplesPerAxis << ", depth " << gRenderSettings.maxDepth << ", " <<
+			level.samplesPerAxis * level.samplesPerAxis << " spp) " << frameMs << " ms of " << m_targetMs << " ms" << std::endl;
+
+		unsigned char* bytes = writer.GetPixelBuffer(m_outputWidth, m_outputHeight);
+		QuantiseFrame(output.data(), m_outputWidth * m_outputHeight, bytes);
+		writer.Submit(bytes, GetFramePath(framePrefix, frame));
+
+		m_level = ChooseLevel(m_level, frameMs);
+	}
+	writer.Flush();
+
+	gRenderSettings = savedSettings;
+	for (unsigned int i = 0; i < allocatedNum; i++)
+		*spheres[i] = restPose[i];
+}
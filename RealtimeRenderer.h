@@ -0,0 +1,67 @@
+#ifndef REALTIMERENDERER_H
+#define REALTIMERENDERER_H
+
+#include <string>
+#include <vector>
+#include "Camera.h"
+#include "SceneSnapshot.h"
+#include "Sphere.h"
+#include "TaskScheduler.h"
+
+// Frame time the real-time mode aims for unless told otherwise, in milliseconds
+#define REALTIME_TARGET_MS 33.0
+
+// What a frame is rendered with at one step of the real-time quality ladder
+struct QualityLevel
+{
+	// internal resolution as a fraction of the output resolution
+	float scale;
+	// capped by RenderSettings::maxDepth
+	int maxDepth;
+	// samples per pixel along each axis, rendered as a larger internal image
+	unsigned int samplesPerAxis;
+};
+
+//[comment]
+// Live preview mode. Every frame is rendered at the current quality level, resampled
+// to the output resolution and written asynchronously. The render time of the frame
+// then picks the next level: above the target it drops as many levels as the
+// estimated cost says are needed, well below it climbs one level if the estimate
+// still fits. Levels trade internal resolution, ray depth and samples per pixel.
+//[/comment]
+class RealtimeRenderer
+{
+public:
+	RealtimeRenderer(TaskScheduler* scheduler, unsigned int outputWidth, unsigned int outputHeight,
+		double targetMs = REALTIME_TARGET_MS);
+	~RealtimeRenderer();
+
+	// Renders frames [firstFrame, endFrame) to <framePrefix><frame>.ppm, logging the
+	// level and time of every frame. The spheres are left in the pose they had before
+	void Run(Sphere** spheres, unsigned int allocatedNum, int firstFrame, int endFrame,
+		const std::string& framePrefix);
+
+	unsigned int GetLevelNum() const { return (unsigned int)m_cameras.size(); }
+	const QualityLevel& GetLevel(unsigned int level) const;
+
+	// Of the frames of the last Run
+	unsigned int GetFramesOnTime() const { return m_framesOnTime; }
+	double GetAverageFrameTime() const { return m_frames > 0 ? m_totalTime / m_frames : 0; }
+
+private:
+	// Relative cost of a level, internal pixels times ray depth
+	double GetCost(unsigned int level) const;
+	unsigned int ChooseLevel(unsigned int level, double frameMs) const;
+
+	TaskScheduler* m_scheduler;
+	unsigned int m_outputWidth, m_outputHeight;
+	double m_targetMs;
+
+	// internal camera of every level
+	std::vector<const Camera*> m_cameras;
+	unsigned int m_level;
+
+	unsigned int m_frames, m_framesOnTime;
+	double m_totalTime;
+};
+#endif
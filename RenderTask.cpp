@@ -0,0 +1,62 @@
+#include "RenderTask.h"
+
+#ifdef RENDER_COROUTINES
+RenderTask::RenderTask(RenderTask&& other) noexcept : m_coroutine(other.m_coroutine)
+{
+	other.m_coroutine = nullptr;
+}
+
+RenderTask& RenderTask::operator=(RenderTask&& other) noexcept
+{
+	if (this != &other)
+	{
+		if (m_coroutine)
+			m_coroutine.destroy();
+		m_coroutine = other.m_coroutine;
+		other.m_coroutine = nullptr;
+	}
+	return *this;
+}
+
+RenderTask::~RenderTask()
+{
+	if (m_coroutine)
+		m_coroutine.destroy();
+}
+
+void RenderTask::Get() const
+{
+	if (m_coroutine && m_coroutine.done() && m_coroutine.promise().exception)
+		std::rethrow_exception(m_coroutine.promise().exception);
+}
+
+std::coroutine_handle<> RenderTask::await_suspend(std::coroutine_handle<> waiting) noexcept
+{
+	m_coroutine.promise().continuation = waiting;
+	return m_coroutine;
+}
+
+FrameAwaiter::FrameAwaiter(TaskScheduler* scheduler, TaskScheduler::FrameHandle frame, const Resumer& resume) :
+	m_scheduler(scheduler), m_frame(frame), m_resume(resume)
+{
+}
+
+bool FrameAwaiter::await_suspend(std::coroutine_handle<> waiting)
+{
+	// copies, the coroutine may go on and destroy this awaiter as soon as it is posted
+	return m_scheduler->WhenDone(m_frame, [waiting, resume = m_resume]()
+		{
+			if (resume)
+				resume(waiting);
+			else
+				waiting.resume();
+		});
+}
+
+RenderTask RenderFrameAsync(TaskScheduler* scheduler, std::shared_ptr<const SceneSnapshot> scene,
+	const Camera* camera, Vec3f* image, FrameStats* stats, double budgetMs,
+	FrameAwaiter::Resumer resume, int priority)
+{
+	co_await FrameAwaiter(scheduler, scheduler->Submit(priority, scene, camera, image, stats, budgetMs), resume);
+}
+#endif
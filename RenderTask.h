@@ -0,0 +1,119 @@
+#ifndef RENDERTASK_H
+#define RENDERTASK_H
+
+// Coroutines need C++20 (/std:c++20 in the project), older standards build without
+// this API
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define RENDER_COROUTINES
+#endif
+#endif
+
+#ifdef RENDER_COROUTINES
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include "Camera.h"
+#include "MpscQueue.h"
+#include "Renderer.h"
+#include "SceneSnapshot.h"
+#include "TaskScheduler.h"
+
+// Coroutines a ResumeQueue holds before the workers posting to it wait
+#define RESUME_QUEUE_SIZE 64
+
+//[comment]
+// Coroutine returned by RenderFrameAsync and by the coroutines that co_await it. It
+// starts suspended: another coroutine co_awaits it and continues once it finished, or
+// plain code Starts it and polls IsDone, from an event loop for example. Destroying
+// the task destroys the coroutine, so keep it until it is done.
+//[/comment]
+class RenderTask
+{
+public:
+	// Continues whoever co_awaited the task once it finished, without growing the stack
+	struct FinalAwaiter
+	{
+		bool await_ready() const noexcept { return false; }
+		template<typename Promise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> finished) noexcept
+		{
+			std::coroutine_handle<> continuation = finished.promise().continuation;
+			return continuation ? continuation : std::noop_coroutine();
+		}
+		void await_resume() const noexcept {}
+	};
+
+	struct promise_type
+	{
+		std::coroutine_handle<> continuation;
+		std::exception_ptr exception;
+
+		RenderTask get_return_object() { return RenderTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_always initial_suspend() const noexcept { return {}; }
+		FinalAwaiter final_suspend() const noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { exception = std::current_exception(); }
+	};
+
+	RenderTask() {}
+	RenderTask(RenderTask&& other) noexcept;
+	RenderTask& operator=(RenderTask&& other) noexcept;
+	RenderTask(const RenderTask&) = delete;
+	RenderTask& operator=(const RenderTask&) = delete;
+	~RenderTask();
+
+	// Runs the coroutine up to its first suspension, once and only if nobody awaits it
+	void Start() { m_coroutine.resume(); }
+	bool IsDone() const { return !m_coroutine || m_coroutine.done(); }
+	// Rethrows what the finished coroutine threw
+	void Get() const;
+
+	// co_await runs a task that was not Started and continues when it finished
+	bool await_ready() const noexcept { return IsDone(); }
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> waiting) noexcept;
+	void await_resume() const { Get(); }
+
+private:
+	explicit RenderTask(std::coroutine_handle<promise_type> coroutine) : m_coroutine(coroutine) {}
+
+	std::coroutine_handle<promise_type> m_coroutine;
+};
+
+//[comment]
+// co_await on a frame submitted to a TaskScheduler: suspends until the last tile of
+// the frame is rendered, or dropped by Cancel, and returns its handle. The waiting
+// coroutine is handed to resume, which an event loop sets to post it to its own
+// thread (a ResumeQueue does). Without one it resumes on the worker that finished
+// the frame, it then must not block on the scheduler.
+//[/comment]
+class FrameAwaiter
+{
+public:
+	typedef std::function<void(std::coroutine_handle<>)> Resumer;
+
+	FrameAwaiter(TaskScheduler* scheduler, TaskScheduler::FrameHandle frame, const Resumer& resume = Resumer());
+
+	bool await_ready() const noexcept { return false; }
+	bool await_suspend(std::coroutine_handle<> waiting);
+	TaskScheduler::FrameHandle await_resume() const { return m_frame; }
+
+private:
+	TaskScheduler* m_scheduler;
+	TaskScheduler::FrameHandle m_frame;
+	Resumer m_resume;
+};
+
+// Coroutines posted by the render workers, popped and resumed by one thread. A fixed
+// ring, posting never allocates or takes a lock
+typedef MpscQueue<std::coroutine_handle<>, RESUME_QUEUE_SIZE> ResumeQueue;
+
+// TaskScheduler::Render without blocking a thread: the frame is submitted when the
+// task starts and the task finishes once every tile ran, so one thread can keep many
+// frames in flight. The camera, image and stats must stay valid until then
+RenderTask RenderFrameAsync(TaskScheduler* scheduler, std::shared_ptr<const SceneSnapshot> scene,
+	const Camera* camera, Vec3f* image, FrameStats* stats = nullptr, double budgetMs = 0,
+	FrameAwaiter::Resumer resume = FrameAwaiter::Resumer(), int priority = 0);
+#endif
+#endif
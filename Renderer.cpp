@@ -0,0 +1,679 @@
+#include "Renderer.h"
+#include "FastMath.h"
+#include "NumaTopology.h"
+#include "TileCuller.h"
+#include "VisibilityBuffer.h"
+#include "WavefrontRenderer.h"
+
+#include <mutex>
+#include <random>
+#include <string.h>
+
+RenderSettings gRenderSettings;
+
+namespace
+{
+	// Per thread so tracing never has to synchronise, collected per tile
+	thread_local unsigned long long tPrunedRays = 0;
+	thread_local std::minstd_rand tRoulette(12345);
+	// Pixel order of the last band this thread rendered, rebuilt when the band size changes
+	thread_local PixelTraversal tTraversal;
+
+	// Copy of the scene on a NUMA node, made by the first thread of the node that
+	// renders it and shared with the node's other threads until the scene changes
+	struct NodeScene
+	{
+		std::weak_ptr<const SceneSnapshot> source;
+		std::shared_ptr<const SceneSnapshot> copy;
+	};
+	std::mutex gNodeSceneMutex;
+	std::vector<NodeScene> gNodeScenes;
+
+	std::shared_ptr<const SceneSnapshot> GetNodeScene(int node, const std::shared_ptr<const SceneSnapshot>& scene)
+	{
+		std::lock_guard<std::mutex> lock(gNodeSceneMutex);
+		if (gNodeScenes.size() <= (size_t)node)
+			gNodeScenes.resize(node + 1);
+
+		// an expired source never equals scene, even if scene reuses its address
+		NodeScene& nodeScene = gNodeScenes[node];
+		if (nodeScene.source.lock() != scene)
+		{
+			nodeScene.copy = SceneSnapshot::CopyLocal(*scene);
+			nodeScene.source = scene;
+		}
+		return nodeScene.copy;
+	}
+}
+
+void ParseRenderSettings(int argc, char** argv)
+{
+	const char* trace = nullptr;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+		{
+			trace = argv[++i];
+			if (strcmp(argv[i], "recursive") == 0)
+				gRenderSettings.traceMode = TraceMode::Recursive;
+			else if (strcmp(argv[i], "iterative") == 0)
+				gRenderSettings.traceMode = TraceMode::Iterative;
+			else if (strcmp(argv[i], "unrolled") == 0)
+				gRenderSettings.traceMode = TraceMode::Unrolled;
+		}
+		else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc)
+			gRenderSettings.maxDepth = std::min(std::max(atoi(argv[++i]), 0), RAY_DEPTH_LIMIT);
+		else if (strcmp(argv[i], "--adaptive-depth") == 0 && i + 1 < argc)
+		{
+			gRenderSettings.adaptiveDepth = true;
+			gRenderSettings.shallowDepth = std::min(std::max(atoi(argv[++i]), 0), RAY_DEPTH_LIMIT);
+		}
+		else if (strcmp(argv[i], "--wavefront") == 0)
+			gRenderSettings.wavefront = true;
+		else if (strcmp(argv[i], "--prune") == 0 && i + 1 < argc)
+			gRenderSettings.pruneEpsilon = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--roulette") == 0)
+			gRenderSettings.russianRoulette = true;
+		else if (strcmp(argv[i], "--fast-math") == 0)
+			gRenderSettings.fastMath = true;
+		else if (strcmp(argv[i], "--no-tile-culling") == 0)
+			gRenderSettings.tileCulling = false;
+		else if (strcmp(argv[i], "--raster") == 0)
+			gRenderSettings.visibilityBuffer = true;
+		else if (strcmp(argv[i], "--numa") == 0)
+			gRenderSettings.pinThreads = true;
+		else if (strcmp(argv[i], "--pixel-order") == 0 && i + 1 < argc)
+		{
+			i++;
+			if (strcmp(argv[i], "scanline") == 0)
+				gRenderSettings.pixelOrder = PixelOrder::Scanline;
+			else if (strcmp(argv[i], "morton") == 0)
+				gRenderSettings.pixelOrder = PixelOrder::Morton;
+			else if (strcmp(argv[i], "hilbert") == 0)
+				gRenderSettings.pixelOrder = PixelOrder::Hilbert;
+		}
+		else if (strcmp(argv[i], "--frame-budget") == 0 && i + 1 < argc)
+			gRenderSettings.frameBudgetMs = std::max(atof(argv[++i]), 0.0);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			gRenderSettings.threadNum = (unsigned int)std::max(atoi(argv[++i]), 0);
+		else if (strcmp(argv[i], "--no-io-uring") == 0)
+			gRenderSettings.ioUring = false;
+	}
+
+	if (gRenderSettings.wavefront && (gRenderSettings.fastMath || trace))
+		std::cout << "--wavefront replaces the per pixel kernels, rendering without --trace and --fast-math" << std::endl;
+#if FAST_MATH_KERNEL
+	else if (gRenderSettings.fastMath && trace)
+		std::cout << "--fast-math replaces the --trace " << trace << " kernel, rendering with the fast math kernel" << std::endl;
+#else
+	else if (gRenderSettings.fastMath)
+		std::cout << "Built without the fast math kernel, --fast-math is ignored" << std::endl;
+	gRenderSettings.fastMath = false;
+#endif
+}
+
+float Mix(const float& a, const float& b, const float& mix)
+{
+	return b * mix + a * (1 - mix);
+}
+
+//[comment]
+// This is the main trace function. It takes a ray as argument (defined by its origin
+// and direction). We test if this ray intersects any of the geometry in the scene.
+// If the ray intersects an object, we compute the intersection point, the normal
+// at the intersection point, and shade this point using this information.
+// Shading depends on the surface property (is it transparent, reflective, diffuse).
+// The function returns a color for the ray. If the ray intersects an object that
+// is the color of the object at the intersection point, otherwise it returns
+// the background color.
+//[/comment]
+Vec3f Trace(
+	const Vec3f &rayorig, const Vec3f &raydir,
+	const SceneSnapshot& scene, const int &depth)
+{
+	//if (raydir.length() != 1) std::cerr << "Error " << raydir << std::endl;
+	const unsigned int allocatedNum = scene.GetSphereNum();
+	if (scene.MissesScene(rayorig, raydir)) return Vec3f(2);
+
+	float tnear = INFINITY;
+	int sphere = -1;
+
+	// find intersection of this ray with the sphere in the scene
+	for (unsigned i = 0; i < allocatedNum; ++i)
+	{
+		float t0 = INFINITY, t1 = INFINITY;
+		if (scene.Intersect(i, rayorig, raydir, t0, t1))
+		{
+			if (t0 < 0) t0 = t1;
+			if (t0 < tnear) 
+			{
+				tnear = t0;
+				sphere = i;
+			}
+		}
+	}
+
+	// if there's no intersection return black or background color
+	if (sphere < 0) return Vec3f(2);
+	Vec3f surfaceColor = 0; // color of the ray/surfaceof the object intersected by the ray
+	Vec3f phit = rayorig + raydir * tnear; // point of intersection
+	const Material& material = scene.GetMaterial(sphere);
+	Vec3f nhit = phit - scene.geometry[sphere].center; // normal at the intersection point
+	nhit.normalize(); // normalize normal direction
+					  // If the normal and the view direction are not opposite to each other
+					  // reverse the normal direction. That also means we are inside the sphere so set
+					  // the inside bool to true. Finally reverse the sign of IdotN which we want
+					  // positive.
+	float bias = 1e-4; // add some bias to the point from which we will be tracing
+	bool inside = false;
+	if (raydir.dot(nhit) > 0) nhit = -nhit, inside = true;
+	if ((material.transparency > 0 || material.reflection > 0) && depth < gRenderSettings.maxDepth) 
+	{
+		float facingratio = -raydir.dot(nhit);
+		// change the mix value to tweak the effect
+		float fresneleffect = Mix(pow(1 - facingratio, 3), 1, 0.1);
+		// compute reflection direction (not need to normalize because all vectors
+		// are already normalized)
+		Vec3f refldir = raydir - nhit * 2 * raydir.dot(nhit);
+		refldir.normalize();
+		Vec3f reflection = Trace(phit + nhit * bias, refldir, scene, depth + 1);
+		Vec3f refraction = 0;
+		// if the sphere is also transparent compute refraction ray (transmission)
+		if (material.transparency) 
+		{
+			float ior = 1.1, eta = (inside) ? ior : 1 / ior; // are we inside or outside the surface?
+			float cosi = -nhit.dot(raydir);
+			float k = 1 - eta * eta * (1 - cosi * cosi);
+			Vec3f refrdir = raydir * eta + nhit * (eta *  cosi - sqrt(k));
+			refrdir.normalize();
+			refraction = Trace(phit - nhit * bias, refrdir, scene, depth + 1);
+		}
+		// the result is a mix of reflection and refraction (if the sphere is transparent)
+		surfaceColor = (reflection * fresneleffect +
+			refraction * (1 - fresneleffect) * material.transparency) * material.surfaceColor;
+	}
+	else 
+	{
+		// it's a diffuse object, no need to raytrace any further
+		for (unsigned int i : scene.GetLights())
+		{
+			// this is a light
+			Vec3f transmission = 1;
+			Vec3f lightDirection = scene.geometry[i].center - phit;
+			lightDirection.normalize();
+			for (unsigned j = 0; j < allocatedNum; ++j)
+			{
+				if (i != j) 
+				{
+					float t0, t1;
+					if (scene.Intersect(j, phit + nhit * bias, lightDirection, t0, t1))
+					{
+						transmission = 0;
+						break;
+					}
+				}
+			}
+			surfaceColor += material.surfaceColor * transmission *
+				std::max(float(0), nhit.dot(lightDirection)) * scene.GetMaterial(i).emissionColor;
+		}
+	}
+	
+	return surfaceColor + material.emissionColor;
+}
+
+namespace
+{
+	struct RayTask
+	{
+		Vec3f orig, dir;
+		Vec3f weight; // how much this ray contributes to the pixel
+		int depth;
+	};
+
+	// Only refraction rays wait on the stack, at most one per depth
+	const int RAY_STACK_SIZE = RAY_DEPTH_LIMIT;
+}
+
+int GetDepthLimit(const SceneSnapshot& scene, int primarySphere)
+{
+	if (!gRenderSettings.adaptiveDepth)
+		return gRenderSettings.maxDepth;
+
+	float mirror = std::max(scene.GetMaterial(primarySphere).reflection, scene.GetMaterial(primarySphere).transparency);
+	if (mirror >= gRenderSettings.adaptiveThreshold)
+		return gRenderSettings.maxDepth;
+	return std::min(gRenderSettings.shallowDepth, gRenderSettings.maxDepth);
+}
+
+bool KeepRay(Vec3f& weight)
+{
+	float contribution = std::max(weight.x, std::max(weight.y, weight.z));
+	if (contribution >= gRenderSettings.pruneEpsilon)
+		return true;
+
+	if (gRenderSettings.russianRoulette)
+	{
+		// survives with a probability proportional to its contribution, on average
+		// the pixel gets the same amount of light as without pruning
+		float survival = contribution / gRenderSettings.pruneEpsilon;
+		if (std::uniform_real_distribution<float>(0, 1)(tRoulette) < survival)
+		{
+			weight = weight / survival;
+			return true;
+		}
+	}
+
+	tPrunedRays++;
+	return false;
+}
+
+Vec3f ShadeDiffuse(const SceneSnapshot& scene, int sphere, const Vec3f& phit, const Vec3f& nhit)
+{
+	const unsigned int allocatedNum = scene.GetSphereNum();
+	const Material& material = scene.GetMaterial(sphere);
+	float bias = 1e-4;
+	Vec3f surfaceColor = 0;
+	for (unsigned int i : scene.GetLights())
+	{
+		// this is a light
+		Vec3f transmission = 1;
+		Vec3f lightDirection = scene.geometry[i].center - phit;
+		lightDirection.normalize();
+		for (unsigned j = 0; j < allocatedNum; ++j)
+		{
+			if (i != j)
+			{
+				float t0, t1;
+				if (scene.Intersect(j, phit + nhit * bias, lightDirection, t0, t1))
+				{
+					transmission = 0;
+					break;
+				}
+			}
+		}
+		surfaceColor += material.surfaceColor * transmission *
+			std::max(float(0), nhit.dot(lightDirection)) * scene.GetMaterial(i).emissionColor;
+	}
+	return surfaceColor;
+}
+
+namespace
+{
+	// Math of the iterative kernel, FastMath selects the float only versions
+	template<bool FastMath>
+	void NormalizeRay(Vec3f& dir)
+	{
+		if (FastMath)
+			FastNormalize(dir);
+		else
+			dir.normalize();
+	}
+
+	template<bool FastMath>
+	float Fresnel(float facingratio)
+	{
+		if (FastMath)
+			return FastFresnel(facingratio);
+		return Mix(pow(1 - facingratio, 3), 1, 0.1);
+	}
+
+	template<bool FastMath>
+	float SquareRoot(float x)
+	{
+		if (FastMath)
+			return std::sqrt(x);
+		return sqrt(x);
+	}
+
+	//[comment]
+	// Iterative version of Trace. The colour returned by Trace is linear in the colours
+	// of the reflection and refraction rays, so instead of recursing every ray carries the
+	// weight it has in the final pixel and each hit adds its own weighted contribution.
+	// The loop keeps following the reflection ray and refraction rays wait on a small
+	// fixed size stack until the current path ends.
+	//[/comment]
+	template<bool FastMath>
+	Vec3f TraceIterativeKernel(
+		const Vec3f& rayorig, const Vec3f& raydir,
+		const SceneSnapshot& scene,
+		const PrimaryHint* hint)
+	{
+		union RayStack { RayStack() {} RayTask rays[RAY_STACK_SIZE]; } stack; // no need to construct the entries
+		int stackSize = 0;
+
+		RayTask ray = { rayorig, raydir, Vec3f(1), 0 };
+		Vec3f pixelColor = 0;
+		int depthLimit = gRenderSettings.maxDepth;
+		for (;;)
+		{
+			float tnear;
+			int sphere;
+			if (hint && ray.depth == 0 && hint->hitSphere >= 0)
+			{
+				sphere = hint->hitSphere;
+				tnear = hint->hitDepth;
+			}
+			else if (hint && ray.depth == 0 && hint->spheres)
+				sphere = scene.FindNearest(ray.orig, ray.dir, tnear, hint->spheres, hint->sphereNum);
+			else
+				sphere = scene.FindNearest(ray.orig, ray.dir, tnear);
+			if (sphere < 0)
+			{
+				pixelColor += ray.weight * Vec3f(2);
+			}
+			else
+			{
+				Vec3f phit = ray.orig + ray.dir * tnear;
+				const Material& material = scene.GetMaterial(sphere);
+				Vec3f nhit = phit - scene.geometry[sphere].center;
+				NormalizeRay<FastMath>(nhit);
+				float bias = 1e-4;
+				bool inside = false;
+				if (ray.dir.dot(nhit) > 0) nhit = -nhit, inside = true;
+
+				if (ray.depth == 0)
+					depthLimit = GetDepthLimit(scene, sphere);
+
+				pixelColor += ray.weight * material.emissionColor;
+				if ((material.transparency > 0 || material.reflection > 0) && ray.depth < depthLimit)
+				{
+					float facingratio = -ray.dir.dot(nhit);
+					float fresneleffect = Fresnel<FastMath>(facingratio);
+					Vec3f surfaceWeight = ray.weight * material.surfaceColor;
+					Vec3f refractionWeight = surfaceWeight * ((1 - fresneleffect) * material.transparency);
+					if (material.transparency && KeepRay(refractionWeight))
+					{
+						float ior = 1.1, eta = (inside) ? ior : 1 / ior;
+						float cosi = -nhit.dot(ray.dir);
+						float k = 1 - eta * eta * (1 - cosi * cosi);
+						Vec3f refrdir = ray.dir * eta + nhit * (eta * cosi - SquareRoot<FastMath>(k));
+						NormalizeRay<FastMath>(refrdir);
+						stack.rays[stackSize++] = { phit - nhit * bias, refrdir, refractionWeight, ray.depth + 1 };
+					}
+
+					Vec3f reflectionWeight = surfaceWeight * fresneleffect;
+					if (KeepRay(reflectionWeight))
+					{
+						Vec3f refldir = ray.dir - nhit * 2 * ray.dir.dot(nhit);
+						NormalizeRay<FastMath>(refldir);
+						ray = { phit + nhit * bias, refldir, reflectionWeight, ray.depth + 1 };
+						continue;
+					}
+				}
+				else
+				{
+					// it's a diffuse object, no need to raytrace any further
+					pixelColor += ray.weight * ShadeDiffuse(scene, sphere, phit, nhit);
+				}
+			}
+
+			// this path ended, continue with the last refraction ray left behind
+			if (stackSize == 0)
+				break;
+			ray = stack.rays[--stackSize];
+		}
+
+		return pixelColor;
+	}
+}
+
+Vec3f TraceIterative(
+	const Vec3f& rayorig, const Vec3f& raydir,
+	const SceneSnapshot& scene,
+	const PrimaryHint* hint)
+{
+	return TraceIterativeKernel<false>(rayorig, raydir, scene, hint);
+}
+
+#if FAST_MATH_KERNEL
+Vec3f TraceFast(
+	const Vec3f& rayorig, const Vec3f& raydir,
+	const SceneSnapshot& scene,
+	const PrimaryHint* hint)
+{
+	return TraceIterativeKernel<true>(rayorig, raydir, scene, hint);
+}
+#endif
+
+namespace
+{
+	//[comment]
+	// Trace with the number of bounces left as a template argument. Every level is its
+	// own function calling the next one, and the last level only has the diffuse/shadow
+	// code that Trace runs once depth reaches the maximum. Gives the same result as
+	// Trace, benchmark 1 times it within run to run noise of the recursive kernel.
+	//[/comment]
+	template<int Remaining>
+	Vec3f TraceLevel(const Vec3f& rayorig, const Vec3f& raydir, const SceneSnapshot& scene)
+	{
+		float tnear;
+		int sphere = scene.FindNearest(rayorig, raydir, tnear);
+		if (sphere < 0) return Vec3f(2);
+
+		Vec3f phit = rayorig + raydir * tnear;
+		const Material& material = scene.GetMaterial(sphere);
+		Vec3f nhit = phit - scene.geometry[sphere].center;
+		nhit.normalize();
+		float bias = 1e-4;
+		bool inside = false;
+		if (raydir.dot(nhit) > 0) nhit = -nhit, inside = true;
+		if (!(material.transparency > 0 || material.reflection > 0))
+			return ShadeDiffuse(scene, sphere, phit, nhit) + material.emissionColor;
+
+		float facingratio = -raydir.dot(nhit);
+		float fresneleffect = Mix(pow(1 - facingratio, 3), 1, 0.1);
+		Vec3f refldir = raydir - nhit * 2 * raydir.dot(nhit);
+		refldir.normalize();
+		Vec3f reflection = TraceLevel<Remaining - 1>(phit + nhit * bias, refldir, scene);
+		Vec3f refraction = 0;
+		if (material.transparency)
+		{
+			float ior = 1.1, eta = (inside) ? ior : 1 / ior;
+			float cosi = -nhit.dot(raydir);
+			float k = 1 - eta * eta * (1 - cosi * cosi);
+			Vec3f refrdir = raydir * eta + nhit * (eta * cosi - sqrt(k));
+			refrdir.normalize();
+			refraction = TraceLevel<Remaining - 1>(phit - nhit * bias, refrdir, scene);
+		}
+		return (reflection * fresneleffect +
+			refraction * (1 - fresneleffect) * material.transparency) * material.surfaceColor +
+			material.emissionColor;
+	}
+
+	template<>
+	Vec3f TraceLevel<0>(const Vec3f& rayorig, const Vec3f& raydir, const SceneSnapshot& scene)
+	{
+		float tnear;
+		int sphere = scene.FindNearest(rayorig, raydir, tnear);
+		if (sphere < 0) return Vec3f(2);
+
+		Vec3f phit = rayorig + raydir * tnear;
+		const Material& material = scene.GetMaterial(sphere);
+		Vec3f nhit = phit - scene.geometry[sphere].center;
+		nhit.normalize();
+		if (raydir.dot(nhit) > 0) nhit = -nhit;
+		return ShadeDiffuse(scene, sphere, phit, nhit) + material.emissionColor;
+	}
+
+	// Picks the TraceLevel instance for a depth only known at runtime
+	template<int Depth>
+	Vec3f TraceFromDepth(const Vec3f& rayorig, const Vec3f& raydir, const SceneSnapshot& scene, int maxDepth)
+	{
+		if (maxDepth >= Depth)
+			return TraceLevel<Depth>(rayorig, raydir, scene);
+		return TraceFromDepth<Depth - 1>(rayorig, raydir, scene, maxDepth);
+	}
+
+	template<>
+	Vec3f TraceFromDepth<0>(const Vec3f& rayorig, const Vec3f& raydir, const SceneSnapshot& scene, int)
+	{
+		return TraceLevel<0>(rayorig, raydir, scene);
+	}
+}
+
+Vec3f TraceUnrolled(
+	const Vec3f& rayorig, const Vec3f& raydir,
+	const SceneSnapshot& scene, int maxDepth)
+{
+	return TraceFromDepth<RAY_DEPTH_LIMIT>(rayorig, raydir, scene, maxDepth);
+}
+
+Vec3f TraceRay(const Vec3f& rayorig, const Vec3f& raydir, const SceneSnapshot& scene,
+	const PrimaryHint* hint)
+{
+#if FAST_MATH_KERNEL
+	if (gRenderSettings.fastMath)
+		return TraceFast(rayorig, raydir, scene, hint);
+#endif
+	switch (gRenderSettings.traceMode)
+	{
+	case TraceMode::Recursive:
+		return Trace(rayorig, raydir, scene, 0);
+	case TraceMode::Unrolled:
+		return TraceUnrolled(rayorig, raydir, scene, gRenderSettings.maxDepth);
+	default:
+		return TraceIterative(rayorig, raydir, scene, hint);
+	}
+}
+
+void FramePrepass::Build(const SceneSnapshot& scene, const Camera& camera,
+	unsigned int startRow, unsigned int endRow)
+{
+	bool fastMath = false;
+#if FAST_MATH_KERNEL
+	fastMath = gRenderSettings.fastMath;
+#endif
+	raster = gRenderSettings.visibilityBuffer;
+	if (raster)
+		visibility.Build(scene, camera, startRow, endRow, fastMath);
+	culling = gRenderSettings.tileCulling && !raster;
+	if (culling)
+		culler.Build(scene, camera, startRow, endRow);
+}
+
+namespace
+{
+	void RenderPixels(unsigned int startHeight, unsigned int endheight, Vec3f* pixel,
+		const SceneSnapshot* scene, const Camera* camera, const FramePrepass* prepass)
+	{
+		const unsigned int width = camera->GetWidth();
+		const float* columnDirection = camera->GetColumnDirections();
+		const float* rowDirection = camera->GetRowDirections();
+
+		bool fastMath = false;
+#if FAST_MATH_KERNEL
+		fastMath = gRenderSettings.fastMath;
+#endif
+		FramePrepass bandPrepass;
+		if (!prepass)
+		{
+			bandPrepass.Build(*scene, *camera, startHeight, endheight);
+			prepass = &bandPrepass;
+		}
+		const bool raster = prepass->raster;
+		const bool culling = prepass->culling;
+		const VisibilityBuffer& visibility = prepass->visibility;
+		const TileCuller& culler = prepass->culler;
+
+		tTraversal.Build(gRenderSettings.pixelOrder, width, endheight - startHeight, startHeight);
+		const unsigned int* order = tTraversal.GetPixels();
+		const unsigned int pixelNum = tTraversal.GetPixelNum();
+		for (unsigned int i = 0; i < pixelNum; ++i)
+		{
+			const unsigned int x = order[i] & 0xffff, y = startHeight + (order[i] >> 16);
+			Vec3f& color = pixel[(y - startHeight) * width + x];
+
+			PrimaryHint hint;
+			if (raster)
+			{
+				hint.hitSphere = visibility.GetSphere(x, y);
+				if (hint.hitSphere < 0)
+				{
+					// no sphere covers the pixel, background
+					color = Vec3f(2);
+					continue;
+				}
+				hint.hitDepth = visibility.GetDepth(x, y);
+			}
+			else if (culling)
+			{
+				hint.sphereNum = culler.GetSphereNum(x, y);
+				if (hint.sphereNum == 0)
+				{
+					// nothing in this tile, background
+					color = Vec3f(2);
+					continue;
+				}
+				hint.spheres = culler.GetSpheres(x, y);
+			}
+
+			Vec3f raydir(columnDirection[x], rowDirection[y], -1);
+#if FAST_MATH_KERNEL
+			if (fastMath)
+			{
+				FastNormalize(raydir);
+				color = TraceFast(Vec3f(0), raydir, *scene, &hint);
+				continue;
+			}
+#endif
+			raydir.normalize();
+
+			color = TraceRay(Vec3f(0), raydir, *scene, &hint);
+		}
+	}
+}
+
+void RenderScreenQuad(unsigned int startHeight, unsigned int endheight, Vec3f* pixel,
+	const SceneSnapshot* scene, const Camera* camera,
+	FrameStats* stats, const FramePrepass* prepass)
+{
+	unsigned long long prunedRays = tPrunedRays;
+	if (gRenderSettings.wavefront)
+	{
+		WavefrontRenderer wavefront;
+		wavefront.Render(startHeight, endheight, pixel, scene, camera);
+	}
+	else
+	{
+		RenderPixels(startHeight, endheight, pixel, scene, camera, prepass);
+	}
+
+	if (stats)
+		stats->prunedRays += tPrunedRays - prunedRays;
+}
+
+void RenderScreenQuadCoarse(unsigned int startHeight, unsigned int endheight, Vec3f* pixel,
+	const SceneSnapshot* scene, const Camera* camera)
+{
+	const unsigned int width = camera->GetWidth(), step = COARSE_PASS_STEP;
+	for (unsigned int blockY = startHeight; blockY < endheight; blockY += step)
+	{
+		unsigned int blockEndY = std::min(blockY + step, endheight);
+		for (unsigned int blockX = 0; blockX < width; blockX += step)
+		{
+			unsigned int blockEndX = std::min(blockX + step, width);
+			// the ray of the pixel nearest the block centre
+			Vec3f color = TraceRay(Vec3f(0), camera->GetRayDirection((blockX + blockEndX) / 2,
+				(blockY + blockEndY) / 2), *scene);
+			for (unsigned int y = blockY; y < blockEndY; ++y)
+			{
+				for (unsigned int x = blockX; x < blockEndX; ++x)
+					pixel[(y - startHeight) * width + x] = color;
+			}
+		}
+	}
+}
+
+void RenderScreenQuadOnNode(int node, unsigned int startHeight, unsigned int endheight, Vec3f* pixel,
+	std::shared_ptr<const SceneSnapshot> scene, const Camera* camera,
+	FrameStats* stats)
+{
+	if (node < 0 || !NumaTopology::GetInstance()->PinThreadToNode(node))
+	{
+		RenderScreenQuad(startHeight, endheight, pixel, scene.get(), camera, stats);
+		return;
+	}
+
+	std::shared_ptr<const SceneSnapshot> localScene = GetNodeScene(node, scene);
+	RenderScreenQuad(startHeight, endheight, pixel, localScene.get(), camera, stats);
+}
@@ -0,0 +1,194 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <atomic>
+#include "Camera.h"
+#include "Commons.h"
+#include "PixelOrder.h"
+#include "SceneSnapshot.h"
+#include "TileCuller.h"
+#include "VisibilityBuffer.h"
+
+#if defined __linux__ || defined __APPLE__
+// "Compiled for Linux
+#else
+// Windows doesn't define these values by default, Linux does
+#define M_PI 3.141592653589793
+#define INFINITY 1e8
+#endif
+
+// This variable controls the default maximum recursion depth
+#define MAX_RAY_DEPTH 5
+// Highest depth the render settings accept, sizes the ray stack of TraceIterative
+#define RAY_DEPTH_LIMIT 16
+// Set to 0 to build without the float only kernel (RenderSettings::fastMath)
+#define FAST_MATH_KERNEL 1
+// Lowest PSNR against the reference kernel the fast math kernel may have
+#define FAST_MATH_MIN_PSNR 40.0
+// Edge of the pixel blocks sharing one camera ray in RenderScreenQuadCoarse
+#define COARSE_PASS_STEP 4
+
+// Recommended Testing Resolution
+//const unsigned int gWidth = 640, gHeight = 480;
+// Recommended Production Resolution
+const unsigned gWidth = 1920, gHeight = 1080;
+
+enum class TraceMode
+{
+	Recursive = 0,
+	Iterative,
+	Unrolled,
+	Max
+};
+
+struct RenderSettings
+{
+	TraceMode traceMode = TraceMode::Iterative;
+	// reflection/refraction rays are traced up to this depth
+	int maxDepth = MAX_RAY_DEPTH;
+	// per pixel depth: only pixels whose camera ray hits a sphere with reflection or
+	// transparency of at least adaptiveThreshold get maxDepth, the others stop at
+	// shallowDepth (the recursive and unrolled Trace always use maxDepth)
+	bool adaptiveDepth = false;
+	int shallowDepth = 1;
+	float adaptiveThreshold = 0.5f;
+	// trace whole bands of rows breadth first (WavefrontRenderer) instead of pixel by
+	// pixel. Uses maxDepth, adaptiveDepth and pruning, ignores the per pixel settings
+	// (traceMode, fastMath, tileCulling, visibilityBuffer, pixelOrder)
+	bool wavefront = false;
+	// secondary rays adding less than this to any channel of the pixel are not traced,
+	// 0 traces everything (the recursive and unrolled Trace never prune)
+	float pruneEpsilon = 0;
+	// keep rays below pruneEpsilon with a probability instead, scaling their weight up
+	bool russianRoulette = false;
+	// per pixel rendering uses TraceFast instead of the kernel of traceMode
+	bool fastMath = false;
+	// per pixel rendering tests camera rays only against the spheres of their
+	// screen tile (TileCuller), pixels of empty tiles get the background directly
+	bool tileCulling = true;
+	// render threads are pinned to a NUMA node and render from a node local copy of
+	// the scene into image memory they touch first
+	bool pinThreads = false;
+	// per pixel rendering takes the camera ray hits from a rasterised VisibilityBuffer
+	// instead (replaces tileCulling), background pixels are not traced at all
+	bool visibilityBuffer = false;
+	// order in which per pixel rendering visits the pixels of a band (PixelTraversal)
+	PixelOrder pixelOrder = PixelOrder::Scanline;
+	// animation frames are written through io_uring where the kernel allows it,
+	// otherwise (or when false) by a write thread, see FrameWriter
+	bool ioUring = true;
+	// wall clock budget of a frame in milliseconds, tiles started after it get the
+	// coarse pass (TaskScheduler), 0 renders every tile in full
+	double frameBudgetMs = 0;
+	// render workers of the TaskScheduler, 0 uses what CpuLimits allows
+	unsigned int threadNum = 0;
+};
+
+extern RenderSettings gRenderSettings;
+
+// Counters of one frame, shared by all threads rendering it
+struct FrameStats
+{
+	std::atomic<unsigned long long> prunedRays;
+	// tiles filled from the coarse pass once the frame's time budget ran out
+	std::atomic<unsigned int> coarseTiles;
+
+	FrameStats() : prunedRays(0), coarseTiles(0) {}
+};
+
+// What is already known about the camera ray of a pixel before tracing it
+struct PrimaryHint
+{
+	// only these spheres can be hit (TileCuller)
+	const unsigned int* spheres = nullptr;
+	unsigned int sphereNum = 0;
+	// the sphere hit and its distance, if already intersected (VisibilityBuffer)
+	int hitSphere = -1;
+	float hitDepth = 0;
+};
+
+// Culling data of the camera rays of a frame, built once per frame and shared by every
+// tile of it
+struct FramePrepass
+{
+	// camera ray hits, when gRenderSettings.visibilityBuffer is on
+	bool raster = false;
+	VisibilityBuffer visibility;
+	// per tile sphere lists, when gRenderSettings.tileCulling is on without raster
+	bool culling = false;
+	TileCuller culler;
+
+	// Builds what gRenderSettings asks for, for the rows [startRow, endRow)
+	void Build(const SceneSnapshot& scene, const Camera& camera,
+		unsigned int startRow, unsigned int endRow);
+};
+
+// Reads the render settings given on the command line:
+// --trace <recursive|iterative|unrolled> --depth <maxDepth> --adaptive-depth <shallowDepth>
+// --wavefront --prune <epsilon> --roulette --fast-math --no-tile-culling --raster --numa
+// --pixel-order <scanline|morton|hilbert> --frame-budget <ms> --threads <n> --no-io-uring
+// --fast-math replaces the --trace kernel and --wavefront replaces both, a warning says
+// so when they are given together
+void ParseRenderSettings(int argc, char** argv);
+
+// Depth limit of a pixel whose camera ray hit this sphere
+int GetDepthLimit(const SceneSnapshot& scene, int primarySphere);
+
+float Mix(const float& a, const float& b, const float& mix);
+
+// Recursive reference version
+Vec3f Trace(
+	const Vec3f& rayorig, const Vec3f& raydir,
+	const SceneSnapshot& scene, const int& depth);
+
+// Same result as Trace, using an explicit ray stack instead of recursion. The hint
+// saves intersecting the camera ray
+Vec3f TraceIterative(
+	const Vec3f& rayorig, const Vec3f& raydir,
+	const SceneSnapshot& scene,
+	const PrimaryHint* hint = nullptr);
+
+#if FAST_MATH_KERNEL
+// TraceIterative with float only math: polynomial Fresnel, rsqrt normalisation and no
+// promotion to double. Close to but not exactly the reference image, see FAST_MATH_MIN_PSNR
+Vec3f TraceFast(
+	const Vec3f& rayorig, const Vec3f& raydir,
+	const SceneSnapshot& scene,
+	const PrimaryHint* hint = nullptr);
+#endif
+
+// Decides if a secondary ray with this weight is still worth tracing, counts the
+// ones that are not. With russian roulette the weight of survivors is scaled up
+bool KeepRay(Vec3f& weight);
+
+// Trace with the depth as a template argument, see Renderer.cpp
+Vec3f TraceUnrolled(
+	const Vec3f& rayorig, const Vec3f& raydir,
+	const SceneSnapshot& scene, int maxDepth);
+
+// Light arriving from the emissive spheres at a diffuse hit, without the hit's own emission
+Vec3f ShadeDiffuse(const SceneSnapshot& scene, int sphere, const Vec3f& phit, const Vec3f& nhit);
+
+// Traces a camera ray with the kernel chosen in gRenderSettings, the recursive and
+// unrolled kernels ignore the hint
+Vec3f TraceRay(const Vec3f& rayorig, const Vec3f& raydir, const SceneSnapshot& scene,
+	const PrimaryHint* hint = nullptr);
+
+// Renders the rows [startHeight, endheight). The prepass has to cover those rows,
+// without one the rows get their own
+void RenderScreenQuad(unsigned int startHeight, unsigned int endheight, Vec3f* pixel,
+	const SceneSnapshot* scene, const Camera* camera,
+	FrameStats* stats = nullptr, const FramePrepass* prepass = nullptr);
+
+// Cheap stand in for RenderScreenQuad, used for tiles past their frame's time budget:
+// one camera ray per COARSE_PASS_STEP square block of pixels, copied to the whole block
+void RenderScreenQuadCoarse(unsigned int startHeight, unsigned int endheight, Vec3f* pixel,
+	const SceneSnapshot* scene, const Camera* camera);
+
+// RenderScreenQuad for a render thread: unless node is -1 the thread is pinned to that
+// NUMA node first and renders from a copy of the scene made there, one copy per node
+// for as long as the scene lives
+void RenderScreenQuadOnNode(int node, unsigned int startHeight, unsigned int endheight, Vec3f* pixel,
+	std::shared_ptr<const SceneSnapshot> scene, const Camera* camera,
+	FrameStats* stats = nullptr);
+#endif
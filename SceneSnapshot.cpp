@@ -0,0 +1,117 @@
+#include "SceneSnapshot.h"
+
+namespace
+{
+	bool SameGeometry(const SceneSnapshot::SphereGeometry& geometry, const Sphere& s)
+	{
+		return geometry.center.x == s.center.x && geometry.center.y == s.center.y &&
+			geometry.center.z == s.center.z && geometry.radius2 == s.radius2;
+	}
+
+	Material GetSphereMaterial(const Sphere& s)
+	{
+		Material material = { s.surfaceColor, s.emissionColor, s.transparency, s.reflection };
+		return material;
+	}
+}
+
+std::shared_ptr<const SceneSnapshot> SceneSnapshot::Create(Sphere** spheres, const unsigned int allocatedNum,
+	const std::shared_ptr<const SceneSnapshot>& previous)
+{
+	if (!previous || previous->m_sphereNum != allocatedNum)
+	{
+		SceneSnapshot* snapshot = new SceneSnapshot();
+		snapshot->m_sphereNum = allocatedNum;
+		snapshot->geometry.resize(allocatedNum);
+		for (unsigned int i = 0; i < allocatedNum; i++)
+			snapshot->geometry[i] = { spheres[i]->center, spheres[i]->radius2 };
+		snapshot->BuildMaterials(spheres);
+		snapshot->BuildBounds();
+		return std::shared_ptr<const SceneSnapshot>(snapshot);
+	}
+
+	// compared against the packed arrays, nothing is copied unless something changed
+	bool geometryChanged = false, materialChanged = false;
+	for (unsigned int i = 0; i < allocatedNum; i++)
+	{
+		geometryChanged = geometryChanged || !SameGeometry(previous->geometry[i], *spheres[i]);
+		materialChanged = materialChanged || !(previous->GetMaterial(i) == GetSphereMaterial(*spheres[i]));
+	}
+	if (!geometryChanged && !materialChanged)
+		return previous;
+
+	SceneSnapshot* snapshot = new SceneSnapshot(*previous);
+	if (geometryChanged)
+	{
+		for (unsigned int i = 0; i < allocatedNum; i++)
+		{
+			if (!SameGeometry(snapshot->geometry[i], *spheres[i]))
+				snapshot->geometry[i] = { spheres[i]->center, spheres[i]->radius2 };
+		}
+		snapshot->BuildBounds();
+	}
+	// the shared entries and the lights depend on every sphere, and there are few
+	if (materialChanged)
+		snapshot->BuildMaterials(spheres);
+	return std::shared_ptr<const SceneSnapshot>(snapshot);
+}
+
+bool SceneSnapshot::MissesScene(const Vec3f& rayorig, const Vec3f& raydir) const
+{
+	Vec3f l = m_boundsCenter - rayorig;
+	float distance2 = l.dot(l);
+	// rays starting inside the bounds can hit anything
+	if (distance2 <= m_boundsRadius2)
+		return false;
+
+	float tca = l.dot(raydir);
+	if (tca < 0) return true;
+	return distance2 - tca * tca > m_boundsRadius2;
+}
+
+void SceneSnapshot::BuildMaterials(Sphere** spheres)
+{
+	materials.clear();
+	materialIndex.resize(m_sphereNum);
+	m_lights.clear();
+	for (unsigned int i = 0; i < m_sphereNum; i++)
+	{
+		// the pool is small, a linear search finds the duplicates
+		Material material = GetSphereMaterial(*spheres[i]);
+		unsigned int m = 0;
+		while (m < materials.size() && !(materials[m] == material))
+			m++;
+		if (m == materials.size())
+			materials.push_back(material);
+		materialIndex[i] = m;
+
+		if (material.emissionColor.x > 0)
+			m_lights.push_back(i);
+	}
+}
+
+void SceneSnapshot::BuildBounds()
+{
+	m_boundsRadius2 = 0;
+	if (m_sphereNum == 0)
+		return;
+
+	Vec3f boundsMin(INFINITY), boundsMax(-INFINITY);
+	for (unsigned int i = 0; i < m_sphereNum; i++)
+	{
+		const SphereGeometry& s = geometry[i];
+		float r = sqrt(s.radius2);
+		boundsMin = Vec3f(std::min(boundsMin.x, s.center.x - r), std::min(boundsMin.y, s.center.y - r),
+			std::min(boundsMin.z, s.center.z - r));
+		boundsMax = Vec3f(std::max(boundsMax.x, s.center.x + r), std::max(boundsMax.y, s.center.y + r),
+			std::max(boundsMax.z, s.center.z + r));
+	}
+
+	m_boundsCenter = (boundsMin + boundsMax) * 0.5f;
+	for (unsigned int i = 0; i < m_sphereNum; i++)
+	{
+		// grow the bound so it contains each whole sphere, with a little slack for rounding
+		float r = ((geometry[i].center - m_boundsCenter).length() + sqrt(geometry[i].radius2)) * 1.0001f;
+		m_boundsRadius2 = std::max(m_boundsRadius2, r * r);
+	}
+}
@@ -0,0 +1,129 @@
+#ifndef SCENESNAPSHOT_H
+#define SCENESNAPSHOT_H
+
+#include <memory>
+#include <vector>
+#include "Commons.h"
+#include "Material.h"
+#include "Sphere.h"
+
+// Immutable copy of the scene taken once per frame and shared (reference counted)
+// by every tile rendering that frame, so the main thread can keep changing the
+// pool spheres while older frames are still being traced.
+class SceneSnapshot
+{
+public:
+	// Starts from the packed arrays of previous and only rewrites the spheres whose
+	// geometry or material differs from it, if nothing changed at all previous itself
+	// is returned.
+	static std::shared_ptr<const SceneSnapshot> Create(Sphere** spheres, const unsigned int allocatedNum,
+		const std::shared_ptr<const SceneSnapshot>& previous = nullptr);
+
+	// Copy of the render data made by the calling thread, so its memory is placed on
+	// that thread's NUMA node (first touch)
+	static std::shared_ptr<const SceneSnapshot> CopyLocal(const SceneSnapshot& scene)
+	{
+		return std::shared_ptr<const SceneSnapshot>(new SceneSnapshot(scene));
+	}
+
+	unsigned int GetSphereNum() const { return m_sphereNum; }
+	const std::vector<unsigned int>& GetLights() const { return m_lights; }
+
+	// Same geometric test as Sphere::intersect, reading the packed arrays
+	bool Intersect(unsigned int index, const Vec3f& rayorig, const Vec3f& raydir, float& t0, float& t1) const
+	{
+		const SphereGeometry& sphere = geometry[index];
+		Vec3f l = sphere.center - rayorig;
+		float tca = l.dot(raydir);
+		if (tca < 0) return false;
+		float d2 = l.dot(l) - tca * tca;
+		if (d2 > sphere.radius2) return false;
+		float thc = sqrt(sphere.radius2 - d2);
+		t0 = tca - thc;
+		t1 = tca + thc;
+
+		return true;
+	}
+
+	// Index of the closest sphere hit by the ray or -1
+	int FindNearest(const Vec3f& rayorig, const Vec3f& raydir, float& tnear) const
+	{
+		if (MissesScene(rayorig, raydir)) return -1;
+
+		int sphere = -1;
+		tnear = INFINITY;
+		for (unsigned i = 0; i < m_sphereNum; ++i)
+		{
+			float t0 = INFINITY, t1 = INFINITY;
+			if (Intersect(i, rayorig, raydir, t0, t1))
+			{
+				if (t0 < 0) t0 = t1;
+				if (t0 < tnear)
+				{
+					tnear = t0;
+					sphere = i;
+				}
+			}
+		}
+		return sphere;
+	}
+
+	// Same, only testing the listed spheres (sorted by index, so ties go the same way)
+	int FindNearest(const Vec3f& rayorig, const Vec3f& raydir, float& tnear,
+		const unsigned int* spheres, unsigned int sphereNum) const
+	{
+		int sphere = -1;
+		tnear = INFINITY;
+		for (unsigned int s = 0; s < sphereNum; ++s)
+		{
+			unsigned int i = spheres[s];
+			float t0 = INFINITY, t1 = INFINITY;
+			if (Intersect(i, rayorig, raydir, t0, t1))
+			{
+				if (t0 < 0) t0 = t1;
+				if (t0 < tnear)
+				{
+					tnear = t0;
+					sphere = i;
+				}
+			}
+		}
+		return sphere;
+	}
+
+	// True if the ray can not hit any sphere of the snapshot
+	bool MissesScene(const Vec3f& rayorig, const Vec3f& raydir) const;
+
+	const Material& GetMaterial(unsigned int sphere) const { return materials[materialIndex[sphere]]; }
+
+	// All the intersection tests read, 16 bytes per sphere
+	struct SphereGeometry
+	{
+		Vec3f center;
+		float radius2;
+	};
+	static_assert(sizeof(SphereGeometry) == 16, "SphereGeometry should stay 16 bytes");
+
+	// Render data: geometry and material index per sphere, spheres with
+	// the same surface share one entry of materials
+	std::vector<SphereGeometry> geometry;
+	std::vector<unsigned int> materialIndex;
+	std::vector<Material> materials;
+
+private:
+	SceneSnapshot() : m_sphereNum(0), m_boundsRadius2(0) {}
+
+	// Rebuilds materials, materialIndex and the lights from the spheres
+	void BuildMaterials(Sphere** spheres);
+	// Rebuilds the scene bounds from geometry
+	void BuildBounds();
+
+	unsigned int m_sphereNum;
+
+	// Acceleration data: emissive spheres for the shadow loop and a sphere
+	// bounding the whole scene to reject rays that miss everything
+	std::vector<unsigned int> m_lights;
+	Vec3f m_boundsCenter;
+	float m_boundsRadius2;
+};
+#endif
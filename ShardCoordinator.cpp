@@ -0,0 +1,195 @@
+#include "ShardCoordinator.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#endif
+
+ShardCoordinator::ShardCoordinator(const std::string& executable, unsigned int workerNum,
+	const std::string& arguments) :
+	m_executable(executable), m_arguments(arguments), m_workerNum(workerNum > 0 ? workerNum : 1), m_running(0)
+{
+}
+
+ShardCoordinator::~ShardCoordinator()
+{
+}
+
+bool ShardCoordinator::Run(const std::string& sceneFile, unsigned int allocated, int frameCount)
+{
+	m_firstFrame.assign(m_workerNum, 0);
+	m_endFrame.assign(m_workerNum, 0);
+	m_exitCode.assign(m_workerNum, 0);
+
+	// contiguous ranges, the first frameCount % workerNum shards get one extra frame
+	int first = 0;
+	for (unsigned int i = 0; i < m_workerNum; i++)
+	{
+		int num = frameCount / (int)m_workerNum + ((int)i < frameCount % (int)m_workerNum ? 1 : 0);
+		m_firstFrame[i] = first;
+		m_endFrame[i] = first + num;
+		first += num;
+
+		// leftovers of an earlier run would look like finished frames
+		for (int frame = m_firstFrame[i]; frame < m_endFrame[i]; frame++)
+			std::remove(GetFramePath(i, frame).c_str());
+	}
+
+	LaunchWorkers(sceneFile, allocated);
+
+	// relaunch crashed workers once for the frames they did not finish
+	bool retry = false;
+	for (unsigned int i = 0; i < m_workerNum; i++)
+	{
+		int missing = FindFirstMissingFrame(i);
+		if (missing < 0)
+		{
+			m_firstFrame[i] = m_endFrame[i];
+			continue;
+		}
+
+		std::cout << "Shard " << i << " exited with " << m_exitCode[i] <<
+			", restarting from frame " << missing << std::endl;
+		m_firstFrame[i] = missing;
+		retry = true;
+	}
+	if (retry)
+		LaunchWorkers(sceneFile, allocated);
+
+	return AssembleFrames(frameCount);
+}
+
+std::string ShardCoordinator::GetFramePrefix(unsigned int shard)
+{
+	std::stringstream ss;
+	ss << "./video/shard" << shard << "_spheres";
+	return ss.str();
+}
+
+void ShardCoordinator::WriteProgress(unsigned int shard, int done, int total)
+{
+	std::ofstream ofs(GetProgressFile(shard), std::ios::out | std::ios::trunc);
+	ofs << done << " " << total << std::endl;
+}
+
+void ShardCoordinator::LaunchWorkers(const std::string& sceneFile, unsigned int allocated)
+{
+	std::vector<std::thread> launchers;
+	for (unsigned int i = 0; i < m_workerNum; i++)
+	{
+		if (m_firstFrame[i] >= m_endFrame[i])
+			continue;
+
+		std::stringstream ss;
+		ss << "\"" << m_executable << "\" --worker " << i << " " << m_firstFrame[i] << " " <<
+			m_endFrame[i] << " " << allocated << " \"" << sceneFile << "\"" << m_arguments;
+		std::string command = ss.str();
+#ifdef _WIN32
+		// system runs cmd /c, which strips the first and last quote of the command
+		command = "\"" + command + "\"";
+#endif
+
+		WriteProgress(i, 0, m_endFrame[i] - m_firstFrame[i]);
+		m_running++;
+		launchers.push_back(std::thread([this, i, command]()
+		{
+			int status = system(command.c_str());
+#ifndef _WIN32
+			// a wait status, turned into the exit code a shell would show
+			if (status != -1 && WIFEXITED(status))
+				status = WEXITSTATUS(status);
+			else if (status != -1 && WIFSIGNALED(status))
+				status = 128 + WTERMSIG(status);
+#endif
+			m_exitCode[i] = status;
+			m_running--;
+		}));
+	}
+
+	while (m_running > 0)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		PrintProgress();
+	}
+
+	for (std::thread& launcher : launchers)
+		launcher.join();
+}
+
+void ShardCoordinator::PrintProgress()
+{
+	std::stringstream ss;
+	ss << "Shards:";
+	for (unsigned int i = 0; i < m_workerNum; i++)
+	{
+		int done = 0, total = 0;
+		std::ifstream ifs(GetProgressFile(i));
+		ifs >> done >> total;
+		ss << " [" << i << "] " << done << "/" << total;
+	}
+	std::cout << ss.str() << std::endl;
+}
+
+int ShardCoordinator::FindFirstMissingFrame(unsigned int shard) const
+{
+	// workers report how many frames from their first one are all written. Frames
+	// finish out of order, so later ones may be done already, but the frame after
+	// done is missing, failed or partly written, and the restart begins there
+	int done = 0, total = 0;
+	std::ifstream ifs(GetProgressFile(shard));
+	ifs >> done >> total;
+	if (m_firstFrame[shard] + done < m_endFrame[shard])
+		return m_firstFrame[shard] + done;
+	return -1;
+}
+
+bool ShardCoordinator::AssembleFrames(int frameCount)
+{
+	// shards cover consecutive ranges, so walking them in order gives the sequence in order
+	m_failedShards.clear();
+	int frame = 0;
+	for (unsigned int i = 0; i < m_workerNum; i++)
+	{
+		bool complete = true;
+		int endFrame = m_endFrame[i];
+		for (; frame < endFrame; frame++)
+		{
+			std::stringstream ss;
+			ss << "./video/spheres" << frame << ".ppm";
+			std::string target = ss.str();
+
+			std::remove(target.c_str());
+			if (std::rename(GetFramePath(i, frame).c_str(), target.c_str()) != 0)
+			{
+				std::cout << "Frame " << frame << " is missing" << std::endl;
+				complete = false;
+			}
+		}
+		std::remove(GetProgressFile(i).c_str());
+		if (!complete)
+			m_failedShards.push_back(i);
+	}
+
+	std::cout << "Assembled " << frameCount << " frames" << (m_failedShards.empty() ? "" : " with gaps") << std::endl;
+	return m_failedShards.empty();
+}
+
+std::string ShardCoordinator::GetFramePath(unsigned int shard, int frame)
+{
+	std::stringstream ss;
+	ss << GetFramePrefix(shard) << frame << ".ppm";
+	return ss.str();
+}
+
+std::string ShardCoordinator::GetProgressFile(unsigned int shard)
+{
+	std::stringstream ss;
+	ss << "./video/shard" << shard << ".progress";
+	return ss.str();
+}
@@ -0,0 +1,50 @@
+#ifndef SHARDCOORDINATOR_H
+#define SHARDCOORDINATOR_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Splits the frame range of an animation across worker processes. Each worker is this
+// executable started with --worker, renders its own frames to its own files and reports
+// progress through a small file. Once all workers are done the frames are renamed to
+// the usual ./video/spheres%d.ppm sequence, so a crashed worker only loses its own frames.
+class ShardCoordinator
+{
+public:
+	// arguments are appended to the command line of every worker
+	ShardCoordinator(const std::string& executable, unsigned int workerNum,
+		const std::string& arguments = "");
+	~ShardCoordinator();
+
+	// Renders frames [0, frameCount) of the scene file with allocated spheres,
+	// returns false if any frame could not be rendered
+	bool Run(const std::string& sceneFile, unsigned int allocated, int frameCount);
+	// Shards with frames missing after the last Run
+	const std::vector<unsigned int>& GetFailedShards() const { return m_failedShards; }
+
+	// Used by the workers
+	static std::string GetFramePrefix(unsigned int shard);
+	static void WriteProgress(unsigned int shard, int done, int total);
+
+private:
+	void LaunchWorkers(const std::string& sceneFile, unsigned int allocated);
+	void PrintProgress();
+	int FindFirstMissingFrame(unsigned int shard) const;
+	bool AssembleFrames(int frameCount);
+
+	static std::string GetFramePath(unsigned int shard, int frame);
+	static std::string GetProgressFile(unsigned int shard);
+
+	std::string m_executable;
+	std::string m_arguments;
+	unsigned int m_workerNum;
+
+	// per shard, frames [firstFrame, endFrame)
+	std::vector<int> m_firstFrame;
+	std::vector<int> m_endFrame;
+	std::vector<int> m_exitCode;
+	std::vector<unsigned int> m_failedShards;
+	std::atomic<unsigned int> m_running;
+};
+#endif
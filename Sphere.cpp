@@ -1,14 +1,14 @@
 #include "Sphere.h"
 
 Sphere::Sphere() :
-	center(Vec3f()), radius(0), radius2(0), surfaceColor(Vec3f()),
+	center(Vec3f()), radius2(0), surfaceColor(Vec3f()),
 	emissionColor(Vec3f()), transparency(0), reflection(0)
 {
 }
 
 Sphere::Sphere(const Vec3f& c, const float& r, const Vec3f& sc,
 	const float& refl, const float& transp, const Vec3f& ec) :
-	center(c), radius(r), radius2(r* r), surfaceColor(sc),
+	center(c), radius2(r* r), surfaceColor(sc),
 	reflection(refl), transparency(transp), emissionColor(ec)
 {
 }
@@ -19,7 +19,6 @@ Sphere::~Sphere()
 
 void Sphere::SetRadius(const float& r)
 {
-	this->radius = r;
 	this->radius2 = r * r;
 }
 
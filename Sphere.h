@@ -5,16 +5,14 @@
 #include "HeapManager.h"
 #include "GlobalMemory.h"
 
+// Only what is rendered, the pool keeps the bookkeeping of each sphere (SphereInfo)
 class Sphere
 {
 public:
 	Vec3f center;                           /// position of the sphere
-	float radius, radius2;                  /// sphere radius and radius^2
+	float radius2;                          /// sphere radius^2
 	Vec3f surfaceColor, emissionColor;      /// surface color and emission (light)
 	float transparency, reflection;         /// surface transparency and reflectivity
-	bool allocated = false; //will not render
-	int poolIndex = -1;
-	Animation* anim = nullptr;
 
 	Sphere();
 	Sphere(const Vec3f& c, const float& r, const Vec3f& sc,
@@ -22,9 +20,9 @@ public:
 	~Sphere();
 
 	void SetRadius(const float& r);
+	float GetRadius() const { return sqrt(radius2); }
 	void SetPosition(const Vec3f& v) { this->center = v; }
 	void SetSurfaceColor(const Vec3f& v) { this->surfaceColor = v; }
-	void SetRender(bool val) { allocated = val; }
 
 	// Compute a ray-sphere intersection using the geometric solution
 	bool intersect(const Vec3f& rayorig, const Vec3f& raydir, float& t0, float& t1) const;
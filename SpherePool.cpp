@@ -1,11 +1,13 @@
 #include "SpherePool.h"
+#include "AnimationSystem.h"
 
 using json = nlohmann::json;
 
 namespace ns {
+	// radius is only written for people reading the file, radius2 is what is loaded
 	void to_json(json& j, const Sphere& s) {
 		j = json{ {"centerX", s.center.x}, {"centerY", s.center.y}, {"centerZ", s.center.z},
-			{"radius", s.radius}, {"radius2", s.radius2},
+			{"radius", s.GetRadius()}, {"radius2", s.radius2},
 			{"surfaceColorX", s.surfaceColor.x}, {"surfaceColorY", s.surfaceColor.y}, {"surfaceColorZ", s.surfaceColor.z},
 			{"emissionColorX", s.emissionColor.x}, {"emissionColorY", s.emissionColor.y}, {"emissionColorZ", s.emissionColor.z},
 			{"transparency", s.transparency}, {"reflection", s.reflection} };
@@ -15,7 +17,6 @@ namespace ns {
 		j.at("centerX").get_to(s.center.x);
 		j.at("centerY").get_to(s.center.y);
 		j.at("centerZ").get_to(s.center.z);
-		j.at("radius").get_to(s.radius);
 		j.at("radius2").get_to(s.radius2);
 		j.at("surfaceColorX").get_to(s.surfaceColor.x);
 		j.at("surfaceColorY").get_to(s.surfaceColor.y);
@@ -61,9 +62,9 @@ void SpherePool::AllocateSphere()
 {
 	for (unsigned int i = m_numAllocated; i < POOL_SIZE; i++)
 	{
-		if (!m_pool[i]->allocated)
+		if (!m_info[i].allocated)
 		{
-			m_pool[i]->allocated = true;
+			m_info[i].allocated = true;
 			m_numAllocated++;
 			return;
 		}
@@ -79,49 +80,56 @@ void SpherePool::DeallocateSphere(unsigned int index)
 	// if deallocating last sphere in the order of allocated spheres
 	if (index == m_numAllocated - 1)
 	{
-		m_pool[index]->allocated = false;
+		m_info[index].allocated = false;
 		m_numAllocated--;
 		return;
 	}
 
 	//if deallocating sphere from anywhere else in the order of allocated spheres
-	m_pool[index]->allocated = false;
+	m_info[index].allocated = false;
 	Sphere* deallocatedS = m_pool[index];
+	SphereInfo deallocatedInfo = m_info[index];
 
-	for (unsigned int i = index; i < m_numAllocated; i++)
+	// the last allocated sphere has nothing after it to move down
+	for (unsigned int i = index; i < m_numAllocated - 1; i++)
 	{
 		//Sphere temp = m_pool[i];
 		m_pool[i] = m_pool[i + 1];
-		m_pool[i]->poolIndex = i;
+		m_info[i] = m_info[i + 1];
+		m_info[i].poolIndex = i;
 		//m_pool[i + 1] = temp;
 	}
 
 	m_numAllocated--;
 	m_pool[m_numAllocated] = deallocatedS;
+	m_info[m_numAllocated] = deallocatedInfo;
 }
 
-void SpherePool::ReadFromJson()
+void SpherePool::ReadFromJson(const std::string& filename)
 {
-	std::ifstream inFile("file.json");
+	std::ifstream inFile(filename);
 	json j = json::array();
 
 	inFile >> j;
+	AnimationSystem::GetInstance()->Clear();
 	for (unsigned int i = 0; i < POOL_SIZE; i++)
 	{
 		ns::from_json(j[i], *m_pool[i]);
-		m_pool[i]->poolIndex = i;
+		m_info[i].poolIndex = i;
+		AnimationSystem::GetInstance()->ReadFromJson(j[i], i);
 	}
 	inFile.close();
 }
 
-void SpherePool::WriteToJson()
+void SpherePool::WriteToJson(const std::string& filename)
 {
-	std::ofstream outFile("file.json");
+	std::ofstream outFile(filename);
 	json j = json::array();
 
 	for (unsigned int i = 0; i < POOL_SIZE; i++)
 	{
 		ns::to_json(j[i], *m_pool[i]);
+		AnimationSystem::GetInstance()->WriteToJson(j[i], i);
 	}
 	outFile << j << std::endl;
 	outFile.close();
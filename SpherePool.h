@@ -7,6 +7,13 @@
 
 constexpr size_t POOL_SIZE = 10;
 
+// Bookkeeping of a pool sphere that the renderer never reads
+struct SphereInfo
+{
+	bool allocated = false; //will not render
+	int poolIndex = -1;
+};
+
 class SpherePool
 {
 public:
@@ -17,10 +24,11 @@ public:
 	void DeallocateSphere(unsigned int index);
 
 	Sphere* GetSphere(int index) { return m_pool[index]; }
+	SphereInfo& GetInfo(int index) { return m_info[index]; }
 	unsigned int GetAllocatedNum() { return m_numAllocated; }
 
-	void ReadFromJson();
-	void WriteToJson();
+	void ReadFromJson(const std::string& filename = "file.json");
+	void WriteToJson(const std::string& filename = "file.json");
 
 	static SpherePool* GetInstance();
 
@@ -28,6 +36,7 @@ private:
 	static SpherePool* m_instance;
 
 	Sphere* m_pool[POOL_SIZE];
+	SphereInfo m_info[POOL_SIZE]; // same order as m_pool
 	unsigned int m_numAllocated;
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,201 @@
+#include "TaskScheduler.h"
+
+#include <chrono>
+#include "NumaTopology.h"
+
+#ifdef __linux__
+#include <time.h>
+#endif
+
+namespace
+{
+	typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+	// CPU time of the calling thread, wall clock time where there is no thread clock
+	double GetThreadTime()
+	{
+#ifdef __linux__
+		timespec time;
+		if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) == 0)
+			return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+#endif
+		return Milliseconds(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
+
+TaskScheduler::TaskScheduler(unsigned int workerNum) : m_stopping(false), m_busyTime(0), m_cpuTime(0)
+{
+	workerNum = std::max(workerNum, 1u);
+	for (unsigned int i = 0; i < workerNum; i++)
+		m_workers.push_back(std::thread(&TaskScheduler::WorkerLoop, this, i, workerNum));
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+		m_tileReady.notify_all();
+	}
+	for (std::thread& worker : m_workers)
+		worker.join();
+}
+
+TaskScheduler::FrameHandle TaskScheduler::Submit(int priority, std::shared_ptr<const SceneSnapshot> scene,
+	const Camera* camera, Vec3f* image, FrameStats* stats, double budgetMs, CompletedTileQueue* completed)
+{
+	FrameHandle frame(new Frame());
+	frame->scene = scene;
+	frame->camera = camera;
+	frame->image = image;
+	frame->stats = stats;
+	frame->budgetMs = budgetMs;
+	frame->completed = completed;
+	frame->droppedTiles = 0;
+	frame->cancelled = false;
+	frame->tileNum = (camera->GetHeight() + SCHEDULER_TILE_ROWS - 1) / SCHEDULER_TILE_ROWS;
+	frame->nextTile = 0;
+	frame->remainingTiles = frame->tileNum;
+	if (!gRenderSettings.wavefront)
+	{
+		frame->prepass.reset(new FramePrepass());
+		frame->prepass->Build(*scene, *camera, 0, camera->GetHeight());
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (frame->tileNum > 0)
+	{
+		m_pending.insert(std::make_pair(priority, frame));
+		m_tileReady.notify_all();
+	}
+	return frame;
+}
+
+void TaskScheduler::Wait(const FrameHandle& frame)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_frameDone.wait(lock, [&frame]() { return frame->remainingTiles == 0; });
+}
+
+bool TaskScheduler::WhenDone(const FrameHandle& frame, const DoneCallback& done)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (frame->remainingTiles == 0)
+		return false;
+	frame->done = done;
+	return true;
+}
+
+void TaskScheduler::Cancel(const FrameHandle& frame)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	frame->cancelled = true;
+	if (frame->nextTile == frame->tileNum)
+		return;
+
+	for (auto pending = m_pending.begin(); pending != m_pending.end(); ++pending)
+	{
+		if (pending->second == frame)
+		{
+			m_pending.erase(pending);
+			break;
+		}
+	}
+	frame->droppedTiles = frame->tileNum - frame->nextTile;
+	frame->remainingTiles -= frame->droppedTiles;
+	frame->nextTile = frame->tileNum;
+	if (frame->remainingTiles == 0)
+		FinishFrame(*frame, lock);
+}
+
+void TaskScheduler::Render(std::shared_ptr<const SceneSnapshot> scene, const Camera* camera, Vec3f* image,
+	FrameStats* stats, double budgetMs)
+{
+	Wait(Submit(0, scene, camera, image, stats, budgetMs));
+}
+
+double TaskScheduler::GetBusyTime() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_busyTime;
+}
+
+double TaskScheduler::GetCpuTime() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_cpuTime;
+}
+
+void TaskScheduler::WorkerLoop(unsigned int worker, unsigned int workerNum)
+{
+	bool pinned = gRenderSettings.pinThreads &&
+		NumaTopology::GetInstance()->PinThreadToNode(NumaTopology::GetInstance()->GetWorkerNode(worker, workerNum));
+	// copy of the current frame's scene on this worker's node, reused by its next tiles
+	std::shared_ptr<const SceneSnapshot> localScene, localSource;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		m_tileReady.wait(lock, [this]() { return !m_pending.empty() || m_stopping; });
+		if (m_pending.empty())
+			return;
+
+		FrameHandle frame = m_pending.begin()->second;
+		unsigned int tile = frame->nextTile++;
+		if (frame->nextTile == frame->tileNum)
+			m_pending.erase(m_pending.begin());
+		// the budget starts with the first tile, not while the frame waits in the queue
+		auto now = std::chrono::steady_clock::now();
+		if (tile == 0)
+			frame->deadline = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(Milliseconds(frame->budgetMs));
+		bool coarse = frame->budgetMs > 0 && now >= frame->deadline;
+		lock.unlock();
+
+		auto start = std::chrono::steady_clock::now();
+		double cpuStart = GetThreadTime();
+		const SceneSnapshot* scene = frame->scene.get();
+		if (pinned)
+		{
+			if (localSource != frame->scene)
+			{
+				localScene = SceneSnapshot::CopyLocal(*scene);
+				localSource = frame->scene;
+			}
+			scene = localScene.get();
+		}
+
+		const unsigned int width = frame->camera->GetWidth(), height = frame->camera->GetHeight();
+		unsigned int startRow = tile * SCHEDULER_TILE_ROWS, endRow = std::min(startRow + SCHEDULER_TILE_ROWS, height);
+		if (coarse)
+			RenderScreenQuadCoarse(startRow, endRow, frame->image + startRow * width, scene, frame->camera);
+		else
+			RenderScreenQuad(startRow, endRow, frame->image + startRow * width, scene, frame->camera, frame->stats,
+				frame->prepass.get());
+		double busy = Milliseconds(std::chrono::steady_clock::now() - start).count();
+		double cpu = GetThreadTime() - cpuStart;
+		if (frame->completed)
+			frame->completed->Push({ frame.get(), startRow, endRow });
+
+		lock.lock();
+		m_busyTime += busy;
+		m_cpuTime += cpu;
+		if (coarse && frame->stats)
+			frame->stats->coarseTiles++;
+		if (--frame->remainingTiles == 0)
+			FinishFrame(*frame, lock);
+	}
+}
+
+void TaskScheduler::FinishFrame(Frame& frame, std::unique_lock<std::mutex>& lock)
+{
+	m_frameDone.notify_all();
+	if (!frame.done)
+		return;
+
+	// the callback may submit more frames, or resume a coroutine that does
+	DoneCallback done;
+	done.swap(frame.done);
+	lock.unlock();
+	done();
+	lock.lock();
+}
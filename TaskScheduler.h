@@ -0,0 +1,118 @@
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Camera.h"
+#include "MpscQueue.h"
+#include "Renderer.h"
+#include "SceneSnapshot.h"
+#include "TileCuller.h"
+
+// Rows of a scheduler tile, a whole row of culling tiles so TileCuller lists line up
+#define SCHEDULER_TILE_ROWS CULL_TILE_SIZE
+// Finished tiles a CompletedTileQueue holds before the workers wait for its consumer
+#define COMPLETED_TILE_QUEUE_SIZE 256
+
+//[comment]
+// One pool of render threads shared by everything that renders frames. A submitted
+// frame is cut into tiles of SCHEDULER_TILE_ROWS rows and the workers pull tiles from
+// every frame in flight, lowest priority value first (then in submission order), so
+// a single frame is spread over all the cores and a sequence of frames keeps them
+// busy without starting a thread per frame.
+// Frames can be cancelled, their tiles nobody took yet are dropped and the ones being
+// rendered finish. A frame can also get a time budget, counted from its first tile:
+// tiles taken after it ran out are filled from a coarse pass (RenderScreenQuadCoarse)
+// and counted in FrameStats::coarseTiles.
+//[/comment]
+class TaskScheduler
+{
+public:
+	struct Frame;
+	typedef std::shared_ptr<Frame> FrameHandle;
+	typedef std::function<void()> DoneCallback;
+
+	// Rows [startRow, endRow) of the frame are in its image
+	struct CompletedTile
+	{
+		const Frame* frame;
+		unsigned int startRow, endRow;
+	};
+	typedef MpscQueue<CompletedTile, COMPLETED_TILE_QUEUE_SIZE> CompletedTileQueue;
+
+	explicit TaskScheduler(unsigned int workerNum);
+	~TaskScheduler();
+
+	// Queues the tiles of a frame, the scene and image must stay valid until Wait
+	// returns. The image does not need to be constructed, every pixel is written
+	// unless the frame is cancelled. A budgetMs of 0 renders every tile in full. Each
+	// finished tile is pushed to completed, if given, so its consumer can use the rows
+	// while the rest of the frame is traced. The frame's FramePrepass is built here,
+	// once for all of its tiles
+	FrameHandle Submit(int priority, std::shared_ptr<const SceneSnapshot> scene, const Camera* camera,
+		Vec3f* image, FrameStats* stats = nullptr, double budgetMs = 0, CompletedTileQueue* completed = nullptr);
+
+	// Blocks until every tile of the frame is rendered, or dropped by Cancel
+	void Wait(const FrameHandle& frame);
+	// Instead of waiting: done is called once the frame is finished, outside the
+	// scheduler's lock on the thread that finished it (its last worker or Cancel).
+	// Returns false without calling it if the frame is finished already. One callback
+	// per frame
+	bool WhenDone(const FrameHandle& frame, const DoneCallback& done);
+
+	// Drops the tiles of the frame no worker has started, can be called from any thread
+	void Cancel(const FrameHandle& frame);
+
+	// Submit and Wait in one
+	void Render(std::shared_ptr<const SceneSnapshot> scene, const Camera* camera, Vec3f* image,
+		FrameStats* stats = nullptr, double budgetMs = 0);
+
+	unsigned int GetWorkerNum() const { return (unsigned int)m_workers.size(); }
+
+	// Milliseconds all workers together spent rendering tiles
+	double GetBusyTime() const;
+	// CPU time of the same, lower than the busy time when the workers outnumber the
+	// CPUs they get (measured as busy time where the platform has no thread clock)
+	double GetCpuTime() const;
+
+private:
+	void WorkerLoop(unsigned int worker, unsigned int workerNum);
+	// Wakes the threads waiting for a frame whose last tile just finished and runs its
+	// callback, lock is held on entry and on return
+	void FinishFrame(Frame& frame, std::unique_lock<std::mutex>& lock);
+
+	std::vector<std::thread> m_workers;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_tileReady, m_frameDone;
+	// frames with tiles nobody took yet, by priority
+	std::multimap<int, FrameHandle> m_pending;
+	bool m_stopping;
+	double m_busyTime, m_cpuTime;
+};
+
+struct TaskScheduler::Frame
+{
+	std::shared_ptr<const SceneSnapshot> scene;
+	const Camera* camera;
+	Vec3f* image;
+	FrameStats* stats;
+	double budgetMs;
+	CompletedTileQueue* completed;
+	// built by Submit for the whole image, the tiles only read it
+	std::unique_ptr<FramePrepass> prepass;
+
+	// guarded by the scheduler, final once Wait returned
+	unsigned int tileNum, nextTile, remainingTiles;
+	unsigned int droppedTiles;
+	bool cancelled;
+	std::chrono::steady_clock::time_point deadline;
+	DoneCallback done;
+};
+#endif
@@ -0,0 +1,78 @@
+#include "TileCuller.h"
+
+namespace
+{
+	// Unit normal of a plane through the camera, pointing into the tile
+	Vec3f PlaneNormal(float x, float y, float z)
+	{
+		Vec3f normal(x, y, z);
+		normal.normalize();
+		return normal;
+	}
+}
+
+TileCuller::TileCuller() : m_tileColumns(0), m_firstTileRow(0)
+{
+}
+
+TileCuller::~TileCuller()
+{
+}
+
+void TileCuller::Build(const SceneSnapshot& scene, const Camera& camera,
+	unsigned int startRow, unsigned int endRow)
+{
+	const unsigned int width = camera.GetWidth(), height = camera.GetHeight();
+	const float* columnDirection = camera.GetColumnDirections();
+	const float* rowDirection = camera.GetRowDirections();
+	m_tileColumns = (width + CULL_TILE_SIZE - 1) / CULL_TILE_SIZE;
+	m_firstTileRow = startRow / CULL_TILE_SIZE;
+	unsigned int endTileRow = (endRow + CULL_TILE_SIZE - 1) / CULL_TILE_SIZE;
+
+	// bounding sphere of every sphere, grown so float rounding in the ray tests
+	// can never make a culled sphere count as hit
+	const unsigned int sphereNum = scene.GetSphereNum();
+	std::vector<float> cullRadius(sphereNum);
+	for (unsigned int i = 0; i < sphereNum; i++)
+	{
+		const SceneSnapshot::SphereGeometry& sphere = scene.geometry[i];
+		cullRadius[i] = sqrt(sphere.radius2) * 1.01f + 1e-3f * sphere.center.length();
+	}
+
+	m_spheres.clear();
+	m_firstSphere.assign(1, 0);
+	for (unsigned int tileRow = m_firstTileRow; tileRow < endTileRow; tileRow++)
+	{
+		unsigned int y0 = tileRow * CULL_TILE_SIZE;
+		unsigned int y1 = std::min(y0 + CULL_TILE_SIZE, height) - 1;
+		for (unsigned int tileColumn = 0; tileColumn < m_tileColumns; tileColumn++)
+		{
+			unsigned int x0 = tileColumn * CULL_TILE_SIZE;
+			unsigned int x1 = std::min(x0 + CULL_TILE_SIZE, width) - 1;
+
+			// the four sides of the tile pyramid, through the outermost pixel rays
+			const Vec3f planes[4] = {
+				PlaneNormal(1, 0, columnDirection[x0]),
+				PlaneNormal(-1, 0, -columnDirection[x1]),
+				PlaneNormal(0, 1, rowDirection[y1]),
+				PlaneNormal(0, -1, -rowDirection[y0]) };
+
+			for (unsigned int i = 0; i < sphereNum; i++)
+			{
+				const Vec3f& center = scene.geometry[i].center;
+				bool inside = true;
+				for (int p = 0; p < 4 && inside; p++)
+					inside = planes[p].dot(center) >= -cullRadius[i];
+				if (inside)
+					m_spheres.push_back(i);
+			}
+			m_firstSphere.push_back((unsigned int)m_spheres.size());
+		}
+	}
+}
+
+float TileCuller::GetAverageSphereNum() const
+{
+	unsigned int tileNum = (unsigned int)m_firstSphere.size() - 1;
+	return tileNum > 0 ? m_spheres.size() / float(tileNum) : 0;
+}
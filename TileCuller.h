@@ -0,0 +1,54 @@
+#ifndef TILECULLER_H
+#define TILECULLER_H
+
+#include <vector>
+#include "Camera.h"
+#include "SceneSnapshot.h"
+
+// Width and height of a culling tile in pixels
+#define CULL_TILE_SIZE 32
+
+// Per tile lists of the spheres a camera ray of that tile can hit. Every tile is
+// the pyramid between the camera rays of its outermost pixels, and a sphere is kept
+// if its bounding cone from the camera overlaps that pyramid, so the primary rays
+// of a tile only need to be tested against its list.
+class TileCuller
+{
+public:
+	TileCuller();
+	~TileCuller();
+
+	// Builds the lists of the tile rows covering [startRow, endRow)
+	void Build(const SceneSnapshot& scene, const Camera& camera,
+		unsigned int startRow, unsigned int endRow);
+
+	unsigned int GetTileColumns() const { return m_tileColumns; }
+
+	// Spheres of the tile containing the pixel, sorted by index
+	const unsigned int* GetSpheres(unsigned int x, unsigned int y) const
+	{
+		return m_spheres.data() + m_firstSphere[GetTile(x, y)];
+	}
+	unsigned int GetSphereNum(unsigned int x, unsigned int y) const
+	{
+		unsigned int tile = GetTile(x, y);
+		return m_firstSphere[tile + 1] - m_firstSphere[tile];
+	}
+
+	// Average list length, for the benchmarks
+	float GetAverageSphereNum() const;
+
+private:
+	unsigned int GetTile(unsigned int x, unsigned int y) const
+	{
+		return (y / CULL_TILE_SIZE - m_firstTileRow) * m_tileColumns + x / CULL_TILE_SIZE;
+	}
+
+	unsigned int m_tileColumns;
+	unsigned int m_firstTileRow;
+
+	// sphere lists of all tiles back to back, tile t owns [m_firstSphere[t], m_firstSphere[t + 1])
+	std::vector<unsigned int> m_spheres;
+	std::vector<unsigned int> m_firstSphere;
+};
+#endif
@@ -0,0 +1,107 @@
+#include "VisibilityBuffer.h"
+#include <functional>
+#include "FastMath.h"
+#include "Renderer.h"
+
+namespace
+{
+	//[comment]
+	// Range of slopes (x / -z, or y / -z) of the camera rays that can hit a sphere,
+	// from the circle the sphere projects to in the xz (or yz) plane. Returns false
+	// if the sphere is completely behind the camera.
+	//[/comment]
+	bool GetSlopeRange(float c, float cz, float radius, double& low, double& high)
+	{
+		double distance2 = (double)c * c + (double)cz * cz;
+		if (distance2 <= (double)radius * radius)
+		{
+			// the camera is inside the circle, every ray can hit it
+			low = -INFINITY;
+			high = INFINITY;
+			return true;
+		}
+
+		double theta = atan2((double)c, -(double)cz);
+		double alpha = asin(radius / sqrt(distance2));
+		if (theta + alpha <= -M_PI * 0.5 || theta - alpha >= M_PI * 0.5)
+			return false;
+		low = theta - alpha <= -M_PI * 0.5 ? -INFINITY : tan(theta - alpha);
+		high = theta + alpha >= M_PI * 0.5 ? INFINITY : tan(theta + alpha);
+		return true;
+	}
+}
+
+VisibilityBuffer::VisibilityBuffer() : m_width(0), m_startRow(0)
+{
+}
+
+VisibilityBuffer::~VisibilityBuffer()
+{
+}
+
+void VisibilityBuffer::Build(const SceneSnapshot& scene, const Camera& camera,
+	unsigned int startRow, unsigned int endRow, bool fastNormalize)
+{
+	m_width = camera.GetWidth();
+	m_startRow = startRow;
+	m_sphere.assign(m_width * (endRow - startRow), -1);
+	m_depth.assign(m_width * (endRow - startRow), INFINITY);
+
+	const float* columnDirection = camera.GetColumnDirections();
+	const float* rowDirection = camera.GetRowDirections();
+	for (unsigned int i = 0; i < scene.GetSphereNum(); i++)
+	{
+		const SceneSnapshot::SphereGeometry& sphere = scene.geometry[i];
+		// grown like the culling radius of TileCuller so rounding can not lose a pixel
+		float radius = sqrt(sphere.radius2) * 1.01f + 1e-3f * sphere.center.length();
+
+		double lowX, highX, lowY, highY;
+		if (!GetSlopeRange(sphere.center.x, sphere.center.z, radius, lowX, highX) ||
+			!GetSlopeRange(sphere.center.y, sphere.center.z, radius, lowY, highY))
+			continue;
+
+		// column directions grow from left to right, row directions shrink from top to bottom
+		unsigned int x0 = (unsigned int)(std::lower_bound(columnDirection, columnDirection + m_width, lowX) - columnDirection);
+		unsigned int x1 = (unsigned int)(std::upper_bound(columnDirection, columnDirection + m_width, highX) - columnDirection);
+		unsigned int y0 = (unsigned int)(std::lower_bound(rowDirection, rowDirection + camera.GetHeight(), highY,
+			std::greater<double>()) - rowDirection);
+		unsigned int y1 = (unsigned int)(std::upper_bound(rowDirection, rowDirection + camera.GetHeight(), lowY,
+			std::greater<double>()) - rowDirection);
+		x0 = x0 > 0 ? x0 - 1 : 0;
+		x1 = std::min(x1 + 1, m_width);
+		y0 = std::max(y0 > 0 ? y0 - 1 : 0, startRow);
+		y1 = std::min(y1 + 1, endRow);
+
+		for (unsigned int y = y0; y < y1; ++y)
+		{
+			for (unsigned int x = x0; x < x1; ++x)
+			{
+				Vec3f raydir(columnDirection[x], rowDirection[y], -1);
+				if (fastNormalize)
+					FastNormalize(raydir);
+				else
+					raydir.normalize();
+
+				float t0 = INFINITY, t1 = INFINITY;
+				if (scene.Intersect(i, Vec3f(0), raydir, t0, t1))
+				{
+					if (t0 < 0) t0 = t1;
+					unsigned int pixel = GetPixel(x, y);
+					if (t0 < m_depth[pixel])
+					{
+						m_depth[pixel] = t0;
+						m_sphere[pixel] = i;
+					}
+				}
+			}
+		}
+	}
+}
+
+float VisibilityBuffer::GetCoverage() const
+{
+	size_t covered = 0;
+	for (int sphere : m_sphere)
+		covered += sphere >= 0;
+	return m_sphere.empty() ? 0 : covered / float(m_sphere.size());
+}
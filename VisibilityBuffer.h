@@ -0,0 +1,40 @@
+#ifndef VISIBILITYBUFFER_H
+#define VISIBILITYBUFFER_H
+
+#include <vector>
+#include "Camera.h"
+#include "SceneSnapshot.h"
+
+// Primary visibility found by rasterising instead of ray tracing. Every camera ray
+// starts at the origin, so each sphere covers a disc on the screen: the spheres are
+// drawn one after the other into the screen rectangle around their disc, keeping
+// the nearest sphere and its distance per pixel. Inside the rectangle the same ray
+// test as FindNearest is used, so the buffer holds exactly the hits FindNearest
+// would return, and pixels no sphere covers are known to be background.
+class VisibilityBuffer
+{
+public:
+	VisibilityBuffer();
+	~VisibilityBuffer();
+
+	// Rasterises the rows [startRow, endRow), fastNormalize has to match the
+	// normalisation of the camera rays that are traced from the buffer
+	void Build(const SceneSnapshot& scene, const Camera& camera,
+		unsigned int startRow, unsigned int endRow, bool fastNormalize = false);
+
+	// Index of the sphere seen through the pixel or -1, and its distance
+	int GetSphere(unsigned int x, unsigned int y) const { return m_sphere[GetPixel(x, y)]; }
+	float GetDepth(unsigned int x, unsigned int y) const { return m_depth[GetPixel(x, y)]; }
+
+	// Share of the pixels covered by a sphere, for the benchmarks
+	float GetCoverage() const;
+
+private:
+	unsigned int GetPixel(unsigned int x, unsigned int y) const { return (y - m_startRow) * m_width + x; }
+
+	unsigned int m_width;
+	unsigned int m_startRow;
+	std::vector<int> m_sphere;
+	std::vector<float> m_depth;
+};
+#endif
@@ -0,0 +1,170 @@
+#include "WavefrontRenderer.h"
+#include "Renderer.h"
+
+namespace
+{
+	// Rows whose camera rays are traced together, bounds the size of the queues
+	const unsigned int WAVEFRONT_ROWS = 16;
+
+	enum SecondaryRayType
+	{
+		REFLECTION_RAY = 0,
+		REFRACTION_RAY,
+		SECONDARY_RAY_TYPES
+	};
+}
+
+WavefrontRenderer::WavefrontRenderer() : m_rayCount(0)
+{
+}
+
+WavefrontRenderer::~WavefrontRenderer()
+{
+}
+
+void WavefrontRenderer::Render(unsigned int startHeight, unsigned int endheight, Vec3f* pixel,
+	const SceneSnapshot* scene, const Camera* camera)
+{
+	const unsigned int width = camera->GetWidth();
+	for (unsigned int batchStart = startHeight; batchStart < endheight; batchStart += WAVEFRONT_ROWS)
+	{
+		unsigned int batchEnd = std::min(batchStart + WAVEFRONT_ROWS, endheight);
+		Vec3f* batchPixel = pixel + (batchStart - startHeight) * width;
+
+		// generate every camera ray of the batch
+		m_rays.clear();
+		for (unsigned int y = batchStart; y < batchEnd; ++y)
+		{
+			for (unsigned int x = 0; x < width; ++x)
+			{
+				Vec3f raydir = camera->GetRayDirection(x, y);
+				unsigned int index = (y - batchStart) * width + x;
+				batchPixel[index] = 0;
+				m_rays.push_back({ Vec3f(0), raydir, Vec3f(1), index, 0, 0, 0 });
+			}
+		}
+
+		// one generation of rays per depth
+		while (!m_rays.empty())
+		{
+			m_rayCount += m_rays.size();
+			IntersectAll(*scene);
+
+			m_nextRays.clear();
+			m_shadows.clear();
+			ShadeHits(*scene, batchPixel);
+			ProcessShadows(*scene, batchPixel);
+
+			SortByKey(m_nextRays, m_sortScratch, m_counts, scene->GetSphereNum() * SECONDARY_RAY_TYPES,
+				[](const WavefrontRay& ray) { return ray.key; });
+			m_rays.swap(m_nextRays);
+		}
+	}
+}
+
+void WavefrontRenderer::IntersectAll(const SceneSnapshot& scene)
+{
+	const size_t rayNum = m_rays.size();
+	m_tnear.assign(rayNum, INFINITY);
+	m_hit.assign(rayNum, -1);
+
+	// sphere by sphere over all rays, the inner loop always reads the same sphere
+	for (unsigned int i = 0; i < scene.GetSphereNum(); ++i)
+	{
+		for (size_t r = 0; r < rayNum; ++r)
+		{
+			float t0 = INFINITY, t1 = INFINITY;
+			if (scene.Intersect(i, m_rays[r].orig, m_rays[r].dir, t0, t1))
+			{
+				if (t0 < 0) t0 = t1;
+				if (t0 < m_tnear[r])
+				{
+					m_tnear[r] = t0;
+					m_hit[r] = i;
+				}
+			}
+		}
+	}
+}
+
+void WavefrontRenderer::ShadeHits(const SceneSnapshot& scene, Vec3f* pixel)
+{
+	float bias = 1e-4;
+	for (size_t r = 0; r < m_rays.size(); ++r)
+	{
+		const WavefrontRay& ray = m_rays[r];
+		int sphere = m_hit[r];
+		if (sphere < 0)
+		{
+			pixel[ray.pixel] += ray.weight * Vec3f(2);
+			continue;
+		}
+
+		Vec3f phit = ray.orig + ray.dir * m_tnear[r];
+		const Material& material = scene.GetMaterial(sphere);
+		Vec3f nhit = phit - scene.geometry[sphere].center;
+		nhit.normalize();
+		bool inside = false;
+		if (ray.dir.dot(nhit) > 0) nhit = -nhit, inside = true;
+
+		int depthLimit = ray.depth == 0 ? GetDepthLimit(scene, sphere) : ray.depthLimit;
+		pixel[ray.pixel] += ray.weight * material.emissionColor;
+		if ((material.transparency > 0 || material.reflection > 0) && ray.depth < depthLimit)
+		{
+			float facingratio = -ray.dir.dot(nhit);
+			float fresneleffect = Mix(pow(1 - facingratio, 3), 1, 0.1);
+			Vec3f surfaceWeight = ray.weight * material.surfaceColor;
+
+			Vec3f reflectionWeight = surfaceWeight * fresneleffect;
+			if (KeepRay(reflectionWeight))
+			{
+				Vec3f refldir = ray.dir - nhit * 2 * ray.dir.dot(nhit);
+				refldir.normalize();
+				m_nextRays.push_back({ phit + nhit * bias, refldir, reflectionWeight,
+					ray.pixel, ray.depth + 1, depthLimit, (unsigned int)(sphere * SECONDARY_RAY_TYPES + REFLECTION_RAY) });
+			}
+
+			Vec3f refractionWeight = surfaceWeight * ((1 - fresneleffect) * material.transparency);
+			if (material.transparency && KeepRay(refractionWeight))
+			{
+				float ior = 1.1, eta = (inside) ? ior : 1 / ior;
+				float cosi = -nhit.dot(ray.dir);
+				float k = 1 - eta * eta * (1 - cosi * cosi);
+				Vec3f refrdir = ray.dir * eta + nhit * (eta * cosi - sqrt(k));
+				refrdir.normalize();
+				m_nextRays.push_back({ phit - nhit * bias, refrdir, refractionWeight,
+					ray.pixel, ray.depth + 1, depthLimit, (unsigned int)(sphere * SECONDARY_RAY_TYPES + REFRACTION_RAY) });
+			}
+		}
+		else
+		{
+			m_shadows.push_back({ phit, nhit, ray.weight, ray.pixel, (unsigned int)sphere });
+		}
+	}
+}
+
+void WavefrontRenderer::ProcessShadows(const SceneSnapshot& scene, Vec3f* pixel)
+{
+	SortByKey(m_shadows, m_shadowScratch, m_counts, scene.GetSphereNum(),
+		[](const ShadowTask& task) { return task.sphere; });
+
+	for (const ShadowTask& task : m_shadows)
+		pixel[task.pixel] += task.weight * ShadeDiffuse(scene, task.sphere, task.phit, task.nhit);
+}
+
+template<typename T, typename KeyFunction>
+void WavefrontRenderer::SortByKey(std::vector<T>& items, std::vector<T>& scratch,
+	std::vector<unsigned int>& counts, unsigned int keyNum, KeyFunction key)
+{
+	// counting sort, stable so rays of a queue stay in pixel order
+	counts.assign(keyNum + 1, 0);
+	for (const T& item : items)
+		counts[key(item) + 1]++;
+	for (unsigned int k = 1; k <= keyNum; k++)
+		counts[k] += counts[k - 1];
+
+	scratch.resize(items.size());
+	for (const T& item : items)
+		scratch[counts[key(item)]++] = item;
+	items.swap(scratch);
+}
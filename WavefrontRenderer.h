@@ -0,0 +1,60 @@
+#ifndef WAVEFRONTRENDERER_H
+#define WAVEFRONTRENDERER_H
+
+#include <vector>
+#include "Camera.h"
+#include "Commons.h"
+#include "SceneSnapshot.h"
+
+// Breadth first alternative to tracing pixel by pixel. All camera rays of a band of
+// rows are intersected together, then the reflection/refraction rays and the shadow
+// work they produce are sorted by type and hit sphere and processed in batches, so
+// consecutive work items read the same sphere and take the same branches.
+class WavefrontRenderer
+{
+public:
+	WavefrontRenderer();
+	~WavefrontRenderer();
+
+	// Same interface and result as RenderScreenQuad
+	void Render(unsigned int startHeight, unsigned int endheight, Vec3f* pixel,
+		const SceneSnapshot* scene, const Camera* camera);
+
+	// Rays traced since construction, without shadow rays
+	unsigned long long GetRayCount() const { return m_rayCount; }
+
+private:
+	struct WavefrontRay
+	{
+		Vec3f orig, dir;
+		Vec3f weight;
+		unsigned int pixel;
+		int depth, depthLimit;
+		unsigned int key; // queue it is sorted into
+	};
+
+	struct ShadowTask
+	{
+		Vec3f phit, nhit;
+		Vec3f weight;
+		unsigned int pixel;
+		unsigned int sphere;
+	};
+
+	void IntersectAll(const SceneSnapshot& scene);
+	void ShadeHits(const SceneSnapshot& scene, Vec3f* pixel);
+	void ProcessShadows(const SceneSnapshot& scene, Vec3f* pixel);
+
+	template<typename T, typename KeyFunction>
+	static void SortByKey(std::vector<T>& items, std::vector<T>& scratch,
+		std::vector<unsigned int>& counts, unsigned int keyNum, KeyFunction key);
+
+	std::vector<WavefrontRay> m_rays, m_nextRays, m_sortScratch;
+	std::vector<ShadowTask> m_shadows, m_shadowScratch;
+	std::vector<float> m_tnear;
+	std::vector<int> m_hit;
+	std::vector<unsigned int> m_counts;
+
+	unsigned long long m_rayCount;
+};
+#endif
@@ -29,28 +29,28 @@
 #include <mutex>
 #include <ctime>
 #include <chrono>
+#include <limits>
 // Windows only
 #include <sstream>
 #include <string.h>
 
 #include "HeapManager.h"
+#include "Camera.h"
 #include "SpherePool.h"
 #include "Sphere.h"
 #include "Commons.h"
 #include "GlobalMemory.h"
-
-#if defined __linux__ || defined __APPLE__
-// "Compiled for Linux
-#else
-// Windows doesn't define these values by default, Linux does
-#define M_PI 3.141592653589793
-#define INFINITY 1e8
-#endif
-
-float Mix(const float& a, const float& b, const float& mix)
-{
-	return b * mix + a * (1 - mix);
-}
+#include "SceneSnapshot.h"
+#include "AnimationSystem.h"
+#include "ShardCoordinator.h"
+#include "Renderer.h"
+#include "Benchmark.h"
+#include "FrameOutput.h"
+#include "FramePipeline.h"
+#include "RealtimeRenderer.h"
+#include "TaskScheduler.h"
+#include "CpuLimits.h"
+#include "RenderTask.h"
 
 float Maxf(float val, float max)
 {
@@ -65,121 +65,19 @@ float Minf(float val, float min)
 	return val;
 }
 
-// This variable controls the maximum recursion depth
-#define MAX_RAY_DEPTH 5
-
 std::mutex gMutex;
-// Recommended Testing Resolution
-//const unsigned int gWidth = 640, gHeight = 480;
-// Recommended Production Resolution
-const unsigned gWidth = 1920, gHeight = 1080;
-
-//[comment]
-// This is the main trace function. It takes a ray as argument (defined by its origin
-// and direction). We test if this ray intersects any of the geometry in the scene.
-// If the ray intersects an object, we compute the intersection point, the normal
-// at the intersection point, and shade this point using this information.
-// Shading depends on the surface property (is it transparent, reflective, diffuse).
-// The function returns a color for the ray. If the ray intersects an object that
-// is the color of the object at the intersection point, otherwise it returns
-// the background color.
-//[/comment]
-Vec3f Trace(
-	const Vec3f &rayorig, const Vec3f &raydir,
-	Sphere** spheres, const unsigned int allocatedNum, const int &depth)
-{
-	//if (raydir.length() != 1) std::cerr << "Error " << raydir << std::endl;
-	float tnear = INFINITY;
-	const Sphere* sphere = NULL;
-
-	// find intersection of this ray with the sphere in the scene
-	for (unsigned i = 0; i < allocatedNum; ++i)
-	{
-		float t0 = INFINITY, t1 = INFINITY;
-		if (spheres[i]->intersect(rayorig, raydir, t0, t1))
-		{
-			if (t0 < 0) t0 = t1;
-			if (t0 < tnear) 
-			{
-				tnear = t0;
-				sphere = spheres[i];
-			}
-		}
-	}
-
-	// if there's no intersection return black or background color
-	if (!sphere) return Vec3f(2);
-	Vec3f surfaceColor = 0; // color of the ray/surfaceof the object intersected by the ray
-	Vec3f phit = rayorig + raydir * tnear; // point of intersection
-	Vec3f nhit = phit - sphere->center; // normal at the intersection point
-	nhit.normalize(); // normalize normal direction
-					  // If the normal and the view direction are not opposite to each other
-					  // reverse the normal direction. That also means we are inside the sphere so set
-					  // the inside bool to true. Finally reverse the sign of IdotN which we want
-					  // positive.
-	float bias = 1e-4; // add some bias to the point from which we will be tracing
-	bool inside = false;
-	if (raydir.dot(nhit) > 0) nhit = -nhit, inside = true;
-	if ((sphere->transparency > 0 || sphere->reflection > 0) && depth < MAX_RAY_DEPTH) 
-	{
-		float facingratio = -raydir.dot(nhit);
-		// change the mix value to tweak the effect
-		float fresneleffect = Mix(pow(1 - facingratio, 3), 1, 0.1);
-		// compute reflection direction (not need to normalize because all vectors
-		// are already normalized)
-		Vec3f refldir = raydir - nhit * 2 * raydir.dot(nhit);
-		refldir.normalize();
-		Vec3f reflection = Trace(phit + nhit * bias, refldir, spheres, allocatedNum, depth + 1);
-		Vec3f refraction = 0;
-		// if the sphere is also transparent compute refraction ray (transmission)
-		if (sphere->transparency) 
-		{
-			float ior = 1.1, eta = (inside) ? ior : 1 / ior; // are we inside or outside the surface?
-			float cosi = -nhit.dot(raydir);
-			float k = 1 - eta * eta * (1 - cosi * cosi);
-			Vec3f refrdir = raydir * eta + nhit * (eta *  cosi - sqrt(k));
-			refrdir.normalize();
-			refraction = Trace(phit - nhit * bias, refrdir, spheres, allocatedNum, depth + 1);
-		}
-		// the result is a mix of reflection and refraction (if the sphere is transparent)
-		surfaceColor = (reflection * fresneleffect +
-			refraction * (1 - fresneleffect) * sphere->transparency) * sphere->surfaceColor;
-	}
-	else 
-	{
-		// it's a diffuse object, no need to raytrace any further
-		for (unsigned i = 0; i < allocatedNum; ++i)
-		{
-			if (spheres[i]->emissionColor.x > 0)
-			{
-				// this is a light
-				Vec3f transmission = 1;
-				Vec3f lightDirection = spheres[i]->center - phit;
-				lightDirection.normalize();
-				for (unsigned j = 0; j < allocatedNum; ++j)
-				{
-					if (i != j) 
-					{
-						float t0, t1;
-						if (spheres[j]->intersect(phit + nhit * bias, lightDirection, t0, t1))
-						{
-							transmission = 0;
-							break;
-						}
-					}
-				}
-				surfaceColor += sphere->surfaceColor * transmission *
-					std::max(float(0), nhit.dot(lightDirection)) * spheres[i]->emissionColor;
-			}
-		}
-	}
-	
-	return surfaceColor + sphere->emissionColor;
-}
-
-Animation* GetAnimInput(int id)
+// Frames are saved as <gFramePrefix><iteration>.ppm
+std::string gFramePrefix = "./video/spheres";
+// The scene of file.json with keyframes on some of its spheres
+const std::string gKeyframeScene = "keyframes.json";
+// Camera rays of every frame, built in main once the heaps exist
+const Camera* gCamera = nullptr;
+// Render threads shared by every frame, also started in main
+TaskScheduler* gScheduler = nullptr;
+
+Animation GetAnimInput(int id)
 {
-	Animation* animation = new Animation();
+	Animation animation;
 
 	std::cout << "Select what you want to change for sphere " << id << ":" << "\n" <<
 		"0. Position" << "\n" <<
@@ -200,8 +98,8 @@ Animation* GetAnimInput(int id)
 		std::cin >> v.z;
 		std::cin.clear();
 
-		animation->aType = (AnimationType)type;
-		animation->changeTo = v / 30.0f;
+		animation.aType = (AnimationType)type;
+		animation.changeTo = v / 30.0f;
 		break;
 	case 1:
 		std::cout << "Please input how much you want the sphere color to change by each second." << "\n" <<
@@ -211,8 +109,8 @@ Animation* GetAnimInput(int id)
 		std::cin >> v.z;
 		std::cin.clear();
 
-		animation->aType = (AnimationType)type;
-		animation->changeTo = v / 30.0f;
+		animation.aType = (AnimationType)type;
+		animation.changeTo = v / 30.0f;
 		break;
 	case 2:
 		std::cout << "Please input how much you want the sphere' radius to change by each second." << "\n" <<
@@ -220,8 +118,8 @@ Animation* GetAnimInput(int id)
 		std::cin >> v.x;
 		std::cin.clear();
 
-		animation->aType = (AnimationType)type;
-		animation->changeTo = v / 30.0f;
+		animation.aType = (AnimationType)type;
+		animation.changeTo = v / 30.0f;
 		break;
 	default:
 		std::cout << "No Animation" << std::endl;
@@ -229,140 +127,84 @@ Animation* GetAnimInput(int id)
 	return animation;
 }
 
-Animation* GetRandomAnim()
+Animation GetRandomAnim()
 {
-	Animation* animation = new Animation();
+	Animation animation;
 	int randAnim = rand() % 4;
 	switch (randAnim)
 	{
 	case 0:
-		animation->aType = AnimationType::Position;
-		animation->changeTo = Vec3f((float)(rand() % 60 - 30) / 100.0f,
+		animation.aType = AnimationType::Position;
+		animation.changeTo = Vec3f((float)(rand() % 60 - 30) / 100.0f,
 			(float)((rand() % 200) - 100) / 100.0f, (float)((rand() % 200) - 100) / 100.0f) / 30.0f;
 		break;
 	case 1:
-		animation->aType = AnimationType::Colour;
-		animation->changeTo = Vec3f((float)(rand() % 100) / 100.0f,
+		animation.aType = AnimationType::Colour;
+		animation.changeTo = Vec3f((float)(rand() % 100) / 100.0f,
 			(float)(rand() % 100) / 100.0f, (float)(rand() % 100) / 100.0f) / 30.0f;
 		break;
 	case 2:
-		animation->aType = AnimationType::Radius;
-		animation->changeTo = Vec3f((float)(rand() % 60) - 20, 0, 0) / 30.0f;
+		animation.aType = AnimationType::Radius;
+		animation.changeTo = Vec3f((float)(rand() % 60) - 20, 0, 0) / 30.0f;
 		break;
 	}
 	return animation;
 }
 
+void PrintFrameStats(int iteration, const FrameStats& stats)
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+	if (gRenderSettings.pruneEpsilon > 0)
+		std::cout << "Frame " << iteration << ": pruned " << stats.prunedRays << " secondary rays" << std::endl;
+	if (stats.coarseTiles > 0)
+		std::cout << "Frame " << iteration << ": over budget, " << stats.coarseTiles << " tiles from the coarse pass" << std::endl;
+}
+
 //[comment]
 // Main rendering function. We compute a camera ray for each pixel of the image
 // trace it and return a color. If the ray hits a sphere, we return the color of the
 // sphere at the intersection point, else we return the background color.
+// The tiles of the frame are spread over the workers of gScheduler.
 //[/comment]
-void Render(Sphere** spheres, const unsigned int allocatedNum, int iteration)
+void Render(std::shared_ptr<const SceneSnapshot> scene, int iteration)
 {
-	Vec3f* image = new Vec3f[gWidth * gHeight], * pixel = image;
-	float invWidth = 1 / float(gWidth), invHeight = 1 / float(gHeight);
-	float fov = 30, aspectratio = gWidth / float(gHeight);
-	float angle = tan(M_PI * 0.5 * fov / 180.);
+	// not constructed, every pixel is written by the worker rendering its tile so its
+	// pages are first touched on that worker's NUMA node
+	Vec3f* image = (Vec3f*)::operator new(sizeof(Vec3f) * gWidth * gHeight);
 	
 	// Trace rays
-	for (unsigned int y = 0; y < gHeight; ++y)
-	{
-		for (unsigned int x = 0; x < gWidth; ++x, ++pixel)
-		{
-			float xx = (2 * ((x + 0.5) * invWidth) - 1) * angle * aspectratio;
-			float yy = (1 - 2 * ((y + 0.5) * invHeight)) * angle;
-			Vec3f raydir(xx, yy, -1);
-			raydir.normalize();
-			*pixel = Trace(Vec3f(0), raydir, spheres, allocatedNum, 0);
-		}
-	}
-
-	// Save result to a PPM image (keep these flags if you compile under Windows)
-	std::stringstream ss;
-	ss << "./video/spheres" << iteration << ".ppm";
-	std::string tempString = ss.str();
-	char* filename = (char*)tempString.c_str();
-
-	std::ofstream ofs(filename, std::ios::out | std::ios::binary);
-	ofs << "P6\n" << gWidth << " " << gHeight << "\n255\n";
-	for (unsigned i = 0; i < gWidth * gHeight; ++i) {
-		ofs << (unsigned char)(std::min(float(1), image[i].x) * 255) <<
-			(unsigned char)(std::min(float(1), image[i].y) * 255) <<
-			(unsigned char)(std::min(float(1), image[i].z) * 255);
-	}
-	ofs.close();
-	delete[] image;
-}
-
-void RenderScreenQuad(unsigned int startHeight, unsigned int endheight, Vec3f* pixel,
-	Sphere** spheres, const unsigned int allocatedNum, 
-	float invWidth, float invHeight, float aspectRatio, float angle)
-{
-	for (unsigned int y = startHeight; y < endheight; ++y)
-	{
-		for (unsigned int x = 0; x < gWidth; ++x, ++pixel)
-		{
-			//if(y == 0 && x == 0)
-			//	std::cout << "Quad: " << pixel << std::endl;
-
-			float xx = (2 * ((x + 0.5) * invWidth) - 1) * angle * aspectRatio;
-			float yy = (1 - 2 * ((y + 0.5) * invHeight)) * angle;
-			Vec3f raydir(xx, yy, -1);
-			raydir.normalize();
-
-			*pixel = Trace(Vec3f(0), raydir, spheres, allocatedNum, 0);
-		}
-	}
+	FrameStats stats;
+	gScheduler->Render(scene, gCamera, image, &stats, gRenderSettings.frameBudgetMs);
+	PrintFrameStats(iteration, stats);
+
+	// Save result to a PPM image
+	std::vector<unsigned char> bytes(gWidth * gHeight * 3);
+	QuantiseFrame(image, gWidth * gHeight, bytes.data());
+	WritePPM(GetFramePath(gFramePrefix, iteration), bytes.data(), gWidth, gHeight);
+	::operator delete(image);
 }
 
-void RenderThreaded(Sphere** spheres, const unsigned int allocatedNum, int iteration)
+// Share of the workers' wall clock time they spent rendering on a CPU
+void PrintParallelEfficiency(double cpuMs, double wallMs)
 {
-	Vec3f* image = new Vec3f[gWidth * gHeight], * pixel = image;
-	float invWidth = 1 / float(gWidth), invHeight = 1 / float(gHeight);
-	float fov = 30, aspectratio = gWidth / float(gHeight);
-	float angle = tan(M_PI * 0.5 * fov / 180.);
-
-	std::thread t[4];
-	int quadHeight = gHeight / 4;
-	// Trace rays
-	for (unsigned int i = 0; i < 4; i++)
-	{
-		int pixelMoveBy = i * (quadHeight * gWidth);
-		t[i] = std::thread(RenderScreenQuad, i * quadHeight, (i + 1) * quadHeight, 
-			pixel + pixelMoveBy, spheres, allocatedNum,
-			invWidth, invHeight, aspectratio, angle);
-	}
-	for (unsigned int i = 0; i < 4; i++)
-	{
-		t[i].join();
-	}
-
-	// Save result to a PPM image (keep these flags if you compile under Windows)
-	std::stringstream ss;
-	ss << "./video/spheres" << iteration << ".ppm";
-	std::string tempString = ss.str();
-	char* filename = (char*)tempString.c_str();
-
-	std::ofstream ofs(filename, std::ios::out | std::ios::binary);
-	ofs << "P6\n" << gWidth << " " << gHeight << "\n255\n";
-	for (unsigned i = 0; i < gWidth * gHeight; ++i) {
-		ofs << (unsigned char)(std::min(float(1), image[i].x) * 255) <<
-			(unsigned char)(std::min(float(1), image[i].y) * 255) <<
-			(unsigned char)(std::min(float(1), image[i].z) * 255);
-	}
-	ofs.close();
-	delete[] image;
+	unsigned int workerNum = gScheduler->GetWorkerNum();
+	std::cout << "Parallel efficiency: " << (wallMs > 0 ? 100 * cpuMs / (wallMs * workerNum) : 0) <<
+		"% (" << cpuMs << " ms of render CPU time over " << wallMs << " ms with " << workerNum << " workers)" << std::endl;
 }
 
 void BasicRender(Sphere** spheres, const unsigned int allocatedNum)
 {
-	Render(spheres, allocatedNum, 0);
+	double cpuBefore = gScheduler->GetCpuTime();
+	auto start = std::chrono::steady_clock::now();
+	Render(SceneSnapshot::Create(spheres, allocatedNum), 0);
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
 	std::cout << "Rendered and saved spheres0.ppm" << std::endl;
+	PrintParallelEfficiency(gScheduler->GetCpuTime() - cpuBefore, elapsed.count());
 }
 
 void SimpleShrinking(Sphere** spheres, const unsigned int allocatedNum)
 {
+	std::shared_ptr<const SceneSnapshot> scene;
 	for (int i = 0; i < 4; i++)
 	{
 		switch (i)
@@ -378,99 +220,198 @@ void SimpleShrinking(Sphere** spheres, const unsigned int allocatedNum)
 			break;
 		}
 		
-		Render(spheres, allocatedNum, i);
+		scene = SceneSnapshot::Create(spheres, allocatedNum, scene);
+		Render(scene, i);
 		std::cout << "Rendered and saved spheres" << i << ".ppm" << std::endl;
 	}
 }
 
 void SmoothScaling(Sphere** spheres, const unsigned int allocatedNum)
 {
+	std::shared_ptr<const SceneSnapshot> scene;
 	for (int r = 0; r < 100; r++)
 	{
 		spheres[0]->SetRadius((float)r / 100);
-		Render(spheres, allocatedNum, r);
+		scene = SceneSnapshot::Create(spheres, allocatedNum, scene);
+		Render(scene, r);
 		std::cout << "Rendered and saved spheres" << r << ".ppm" << std::endl;
 	}
 }
 
-void AnimsApplied(std::thread* t, Sphere** spheres, 
-	unsigned int allocatedNum, int count, int maxCount)
+// Renders frames [firstFrame, endFrame) through the animate/render/encode pipeline
+void AnimsApplied(Sphere** spheres, unsigned int allocatedNum, int firstFrame, int endFrame)
+{
+	FramePipeline pipeline(gCamera, gScheduler);
+	pipeline.Run(spheres, allocatedNum, firstFrame, endFrame, gFramePrefix,
+		[](int frame, const FrameStats& stats, bool written)
+		{
+			PrintFrameStats(frame, stats);
+			std::lock_guard<std::mutex> lock(gMutex);
+			if (written)
+				std::cout << "Rendered and saved spheres" << frame << ".ppm" << std::endl;
+			else
+				std::cout << "Could not save spheres" << frame << ".ppm" << std::endl;
+		});
+
+	std::cout << "Busy time per stage: animate " << pipeline.GetAnimateTime() << " ms, render " <<
+		pipeline.GetRenderTime() << " ms over " << gScheduler->GetWorkerNum() << " workers, encode " << pipeline.GetEncodeTime() << " ms" << std::endl;
+	PrintParallelEfficiency(pipeline.GetRenderCpuTime(), pipeline.GetWallTime());
+
+	const FrameWriter& writer = pipeline.GetWriter();
+	std::cout << "Frame output (" << writer.GetBackendName() << "): " << writer.GetBytesWritten() / 1000000.0 <<
+		" MB at " << writer.GetBandwidth() << " MB/s, queue depth " << writer.GetAverageQueueDepth() <<
+		" average, " << writer.GetMaxQueueDepth() << " max";
+	if (writer.GetFailedWrites() > 0)
+		std::cout << ", " << writer.GetFailedWrites() << " frames failed";
+	std::cout << std::endl;
+}
+
+#ifdef RENDER_COROUTINES
+// One animation frame as a coroutine, it holds no thread while its tiles render and
+// saves the frame once resumed from resumed
+RenderTask RenderFrameJob(std::shared_ptr<const SceneSnapshot> scene, int iteration, ResumeQueue* resumed)
+{
+	Vec3f* image = (Vec3f*)::operator new(sizeof(Vec3f) * gWidth * gHeight);
+	FrameStats stats;
+	co_await RenderFrameAsync(gScheduler, scene, gCamera, image, &stats, gRenderSettings.frameBudgetMs,
+		[resumed](std::coroutine_handle<> waiting) { resumed->Push(waiting); }, iteration);
+	PrintFrameStats(iteration, stats);
+
+	std::vector<unsigned char> bytes(gWidth * gHeight * 3);
+	QuantiseFrame(image, gWidth * gHeight, bytes.data());
+	WritePPM(GetFramePath(gFramePrefix, iteration), bytes.data(), gWidth, gHeight);
+	::operator delete(image);
+
+	std::lock_guard<std::mutex> lock(gMutex);
+	std::cout << "Rendered and saved spheres" << iteration << ".ppm" << std::endl;
+}
+
+// Renders frames [firstFrame, endFrame) as coroutine jobs: this thread alone keeps
+// one frame per worker and one more in flight, and saves each frame when its job is
+// resumed, like an event loop serving many render requests
+void AnimsAsJobs(Sphere** spheres, unsigned int allocatedNum, int firstFrame, int endFrame)
 {
-	/*if (count == 50)
+	std::vector<Sphere> restPose;
+	for (unsigned int i = 0; i < allocatedNum; i++)
+		restPose.push_back(*spheres[i]);
+
+	const size_t jobNum = gScheduler->GetWorkerNum() + 1;
+	ResumeQueue resumed;
+	std::vector<RenderTask> jobs;
+	std::shared_ptr<const SceneSnapshot> scene;
+	int frame = firstFrame;
+	while (frame < endFrame || !jobs.empty())
 	{
-		SpherePool::GetInstance()->DeallocateSphere(0);
-		allocatedNum = SpherePool::GetInstance()->GetAllocatedNum();
-		
-		Sphere** overrideSpheres = new Sphere * [allocatedNum];
-		for (unsigned int i = 0; i < allocatedNum; i++)
+		if (frame < endFrame && jobs.size() < jobNum)
 		{
-			overrideSpheres[i] = SpherePool::GetInstance()->GetSphere(i);
+			AnimationSystem::GetInstance()->Evaluate(spheres, restPose.data(), allocatedNum, (float)frame);
+			scene = SceneSnapshot::Create(spheres, allocatedNum, scene);
+			jobs.push_back(RenderFrameJob(scene, frame, &resumed));
+			jobs.back().Start();
+			frame++;
+			continue;
 		}
-		spheres = *overrideSpheres;
-	}
 
-	if (count == 30)
-	{
-		SpherePool::GetInstance()->AllocateSphere();
-		allocatedNum = SpherePool::GetInstance()->GetAllocatedNum();
-		
-		Sphere** overrideSpheres = new Sphere * [allocatedNum];
-		for (unsigned int i = 0; i < allocatedNum; i++)
+		std::coroutine_handle<> waiting;
+		if (resumed.Pop(waiting, std::chrono::milliseconds(100)))
+			waiting.resume();
+		for (size_t i = 0; i < jobs.size();)
 		{
-			overrideSpheres[i] = SpherePool::GetInstance()->GetSphere(i);
+			if (!jobs[i].IsDone())
+			{
+				i++;
+				continue;
+			}
+			jobs[i].Get();
+			jobs.erase(jobs.begin() + i);
 		}
-		overrideSpheres[allocatedNum - 1]->anim = GetRandomAnim();
-		spheres = *overrideSpheres;
-	}*/
+	}
 
 	for (unsigned int i = 0; i < allocatedNum; i++)
-	{
-		if (!spheres[i]->anim)
-			continue;
-
-		if (spheres[i]->anim->aType == AnimationType::Max)
-			continue;
+		*spheres[i] = restPose[i];
+}
+#endif
 
-		//Vec3f changeAmount = spheres[i]->anim->changeTo / 30.0f;
-		switch (spheres[i]->anim->aType)
+void ChooseAnimations(Sphere** spheres, const unsigned int allocatedNum)
+{
+	bool chosen = false;
+	while (!chosen)
+	{
+		std::cout << "Do you want random animations to be appllied:" << "\n" <<
+			"1. Yes" << "\n" <<
+			"2. No" << "\n" <<
+			"3. Use the keyframes of the sample scene (" << gKeyframeScene << ")" << std::endl;
+		int randAnim;
+		std::cin >> randAnim;
+		switch (randAnim)
 		{
-		case AnimationType::Position:
-			spheres[i]->SetPosition(spheres[i]->center + 
-				spheres[i]->anim->changeTo);
+		case 1:
+			AnimationSystem::GetInstance()->Clear();
+			for (unsigned int i = 0; i < allocatedNum; i++)
+			{
+				if (SpherePool::GetInstance()->GetInfo(i).allocated)
+					AnimationSystem::GetInstance()->AddAnimation(i, *spheres[i], GetRandomAnim());
+			}
+			chosen = true;
+			break;
+		case 2:
+			AnimationSystem::GetInstance()->Clear();
+			for (unsigned int i = 0; i < allocatedNum; i++)
+			{
+				if (SpherePool::GetInstance()->GetInfo(i).allocated)
+					AnimationSystem::GetInstance()->AddAnimation(i, *spheres[i], GetAnimInput(i));
+			}
+			chosen = true;
 			break;
-		case AnimationType::Colour:
-			spheres[i]->SetSurfaceColor((spheres[i]->surfaceColor + 
-				spheres[i]->anim->changeTo).MaxVec(1.0f));
+		case 3:
+			// the sample is file.json with keyframes added, it replaces the spheres too
+			SpherePool::GetInstance()->ReadFromJson(gKeyframeScene);
+			chosen = true;
 			break;
-		case AnimationType::Radius:
-			spheres[i]->SetRadius(Minf(spheres[i]->radius + 
-				(spheres[i]->anim->changeTo.x / 100), 0.1f));
+		default:
+			std::cin.clear();
+			std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
 			break;
 		}
 	}
+}
 
-	Sphere** s = new Sphere*[allocatedNum];
-	for (unsigned int i = 0; i < allocatedNum; i++)
-	{
-		s[i] = new Sphere(*spheres[i]);
-	}
+//[comment]
+// Worker side of ShardCoordinator. Renders frames [firstFrame, endFrame) of the scene
+// file through a FramePipeline and reports its progress to the coordinator. gScheduler
+// has a single worker here, or this shard's share of the coordinator's --threads.
+//[/comment]
+int RenderShard(unsigned int shard, int firstFrame, int endFrame,
+	unsigned int allocated, const std::string& sceneFile)
+{
+	SpherePool::GetInstance()->ReadFromJson(sceneFile);
+	for (unsigned int i = 0; i < allocated && i < POOL_SIZE; i++)
+		SpherePool::GetInstance()->AllocateSphere();
+	allocated = SpherePool::GetInstance()->GetAllocatedNum();
 
-	t[count] = std::thread(Render, s, allocatedNum, count);
-	//t[count] = std::thread(RenderThreaded, s, allocatedNum, count);
-	std::cout << "Rendered and saved spheres" << count << ".ppm" << std::endl;
-	
-	count++;
-	if(count < maxCount)
-		AnimsApplied(t, spheres, allocatedNum, count, maxCount);
-	t[count - 1].join();
+	Sphere** spheres = new Sphere * [allocated];
+	for (unsigned int i = 0; i < allocated; i++)
+		spheres[i] = SpherePool::GetInstance()->GetSphere(i);
 
-	for (unsigned int i = 0; i < allocatedNum; i++)
-	{
-		delete s[i];
-		s[i] = nullptr;
-	}
-	delete[] s;
-	s = nullptr;
+	// frames can finish writing out of order, the progress is the frames from
+	// firstFrame on that are all written, so a restart never skips a missing one
+	std::vector<bool> written(endFrame > firstFrame ? endFrame - firstFrame : 0, false);
+	int done = 0;
+	FramePipeline pipeline(gCamera, gScheduler);
+	pipeline.Run(spheres, allocated, firstFrame, endFrame, ShardCoordinator::GetFramePrefix(shard),
+		[&](int frame, const FrameStats&, bool succeeded)
+		{
+			if (!succeeded)
+				return;
+			written[frame - firstFrame] = true;
+			while (done < (int)written.size() && written[done])
+				done++;
+			ShardCoordinator::WriteProgress(shard, done, (int)written.size());
+		});
+
+	delete[] spheres;
+	// the coordinator restarts the shard from the first frame that failed
+	return done == (int)written.size() ? 0 : 1;
 }
 
 //[comment]
@@ -483,9 +424,29 @@ int main(int argc, char** argv)
 	srand(time(NULL));
 
 	HeapManager::GetInstance()->Init();
+	ParseRenderSettings(argc, argv);
+	gCamera = new Camera(gWidth, gHeight);
+
+	// started by a ShardCoordinator: --worker <shard> <firstFrame> <endFrame> <allocated> <sceneFile>
+	if (argc >= 7 && strcmp(argv[1], "--worker") == 0)
+	{
+		// the coordinator already runs one process per shard
+		gScheduler = new TaskScheduler(gRenderSettings.threadNum > 0 ? gRenderSettings.threadNum : 1);
+		return RenderShard(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]),
+			atoi(argv[5]), argv[6]);
+	}
 
-	const int maxImgCount = 100; //same number of threads as images
-	std::thread t[maxImgCount];
+	CpuLimits limits = DetectCpuLimits();
+	gScheduler = new TaskScheduler(gRenderSettings.threadNum > 0 ? gRenderSettings.threadNum : limits.GetWorkerNum());
+	std::cout << "Render workers: " << gScheduler->GetWorkerNum() << " (hardware threads " << limits.hardwareThreads <<
+		", affinity " << limits.affinityCpus << ", cgroup quota ";
+	if (limits.quotaCpus > 0)
+		std::cout << limits.quotaCpus << " CPUs";
+	else
+		std::cout << "none";
+	std::cout << (gRenderSettings.threadNum > 0 ? ", set by --threads)" : ")") << std::endl;
+
+	const int maxImgCount = 100;
 	std::chrono::time_point<std::chrono::system_clock> start;
 	std::chrono::time_point<std::chrono::system_clock> end;
 
@@ -534,7 +495,11 @@ int main(int argc, char** argv)
 		"1. Basic Render" << "\n" <<
 		"2. Simple Shrinking" << "\n" <<
 		"3. SmoothScaling" << "\n" <<
-		"4. Use Animations" << std::endl;
+		"4. Use Animations" << "\n" <<
+		"5. Use Animations across worker processes" << "\n" <<
+		"6. Benchmarks" << "\n" <<
+		"7. Real-time preview" << "\n" <<
+		"8. Use Animations as coroutine render jobs" << std::endl;
 
 	int renderType;
 	std::cin >> renderType;
@@ -553,38 +518,99 @@ int main(int argc, char** argv)
 		SmoothScaling(spheres, allocated);
 		break;
 	case 4:
-		std::cout << "Do you want random animations to be appllied:" << "\n" <<
-			"1. Yes" << "\n" <<
-			"2. No" << std::endl;
-		int randAnim;
-		std::cin >> randAnim;
-		if (randAnim == 1)
+	{
+		ChooseAnimations(spheres, allocated);
+
+		std::cout << "Chrono Start-" << std::endl;
+		start = std::chrono::system_clock::now();
+		AnimsApplied(spheres, allocated, 0, maxImgCount);
+		end = std::chrono::system_clock::now();
+
+		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+		std::cout << "Chrono End-" << std::endl;
+		std::cout << "Time taken = " << elapsed.count() << std::endl;
+		break;
+	}
+	case 5:
+	{
+		ChooseAnimations(spheres, allocated);
+
+		std::cout << "How many worker processes do you want to use?" << std::endl;
+		unsigned int workerNum;
+		std::cin >> workerNum;
+
+		// the workers load the scene, including the chosen animations, from this file
+		const std::string sceneFile = "./video/shard_scene.json";
+		SpherePool::GetInstance()->WriteToJson(sceneFile);
+
+		std::cout << "Chrono Start-" << std::endl;
+		start = std::chrono::system_clock::now();
+		// workers get the same render settings, except that --threads is shared out
+		// between them instead of started in every one
+		std::string settings;
+		for (int i = 1; i < argc; i++)
 		{
-			for (unsigned int i = 0; i < allocated; i++)
+			if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
 			{
-				if (spheres[i]->allocated)
-					spheres[i]->anim = GetRandomAnim();
+				i++;
+				continue;
 			}
+			settings += std::string(" ") + argv[i];
 		}
-		else
+		if (gRenderSettings.threadNum > 0)
+			settings += " --threads " + std::to_string(std::max(gRenderSettings.threadNum / std::max(workerNum, 1u), 1u));
+		ShardCoordinator coordinator(argv[0], workerNum, settings);
+		if (!coordinator.Run(sceneFile, allocated, maxImgCount))
 		{
-			for (unsigned int i = 0; i < allocated; i++)
-			{
-				if (spheres[i]->allocated)
-					spheres[i]->anim = GetAnimInput(i);
-			}
+			std::cout << "Frames missing from shard";
+			for (unsigned int shard : coordinator.GetFailedShards())
+				std::cout << " " << shard;
+			std::cout << std::endl;
 		}
+		end = std::chrono::system_clock::now();
+		std::remove(sceneFile.c_str());
 
+		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+		std::cout << "Chrono End-" << std::endl;
+		std::cout << "Time taken = " << elapsed.count() << std::endl;
+		break;
+	}
+	case 6:
+		RunBenchmarks(spheres, allocated, gCamera);
+		return 0;
+	case 7:
+	{
+		ChooseAnimations(spheres, allocated);
+
+		std::cout << "Target frame time in ms?" << std::endl;
+		double targetMs;
+		std::cin >> targetMs;
+
+		RealtimeRenderer preview(gScheduler, gWidth, gHeight, targetMs > 0 ? targetMs : REALTIME_TARGET_MS);
+		preview.Run(spheres, allocated, 0, maxImgCount, gFramePrefix);
+		std::cout << preview.GetFramesOnTime() << " of " << maxImgCount << " frames on time, " <<
+			preview.GetAverageFrameTime() << " ms per frame" << std::endl;
+		break;
+	}
+	case 8:
+	{
+		ChooseAnimations(spheres, allocated);
+
+#ifdef RENDER_COROUTINES
 		std::cout << "Chrono Start-" << std::endl;
 		start = std::chrono::system_clock::now();
-		AnimsApplied(t, spheres, allocated, 0, maxImgCount);
+		AnimsAsJobs(spheres, allocated, 0, maxImgCount);
 		end = std::chrono::system_clock::now();
 
 		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
 		std::cout << "Chrono End-" << std::endl;
 		std::cout << "Time taken = " << elapsed.count() << std::endl;
+#else
+		std::cout << "Render jobs need a C++20 build with coroutines" << std::endl;
+#endif
 		break;
 	}
+	}
 
 	system("ffmpeg -y -r 60 -f image2 -s 1920*1080 -i video/spheres%d.ppm -vcodec libx264 -crf 25 -pix_fmt yuv420p video/RaytracingOutput.mp4");
 